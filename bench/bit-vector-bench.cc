@@ -0,0 +1,137 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <marisa2/grimoire/bit-vector.h>
+
+namespace {
+
+// The default size is much larger than last level caches.
+constexpr std::size_t DEFAULT_NUM_BITS = std::size_t(1) << 31;
+constexpr std::size_t NUM_QUERIES = std::size_t(1) << 22;
+
+class Timer {
+ public:
+  Timer() : begin_(std::chrono::steady_clock::now()) {}
+
+  // elapsed() returns the elapsed time in nanoseconds.
+  double elapsed() const {
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - begin_).count();
+  }
+
+ private:
+  std::chrono::steady_clock::time_point begin_;
+};
+
+void print_result(const char *name, double scalar_ns, double batch_ns) {
+  std::cout << std::setw(12) << std::left << name << std::right << std::fixed
+            << std::setprecision(2)
+            << "  scalar: " << std::setw(7) << (scalar_ns / NUM_QUERIES)
+            << " ns  batch: " << std::setw(7) << (batch_ns / NUM_QUERIES)
+            << " ns  speedup: " << (scalar_ns / batch_ns) << 'x' << std::endl;
+}
+
+// benchmark() compares a scalar loop of query() with batch_query().
+template <typename Query, typename BatchQuery>
+int benchmark(const char *name, const std::vector<std::size_t> &args,
+              Query query, BatchQuery batch_query) {
+  std::vector<std::size_t> scalar_out(args.size());
+  Timer scalar_timer;
+  for (std::size_t i = 0; i < args.size(); ++i) {
+    scalar_out[i] = query(args[i]);
+  }
+  const double scalar_ns = scalar_timer.elapsed();
+
+  std::vector<std::size_t> batch_out(args.size());
+  Timer batch_timer;
+  batch_query(args.data(), batch_out.data(), args.size());
+  const double batch_ns = batch_timer.elapsed();
+
+  if (scalar_out != batch_out) {
+    std::cerr << "error: " << name << ": batch returned wrong results"
+              << std::endl;
+    return 1;
+  }
+  print_result(name, scalar_ns, batch_ns);
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::ios::sync_with_stdio(false);
+
+  std::size_t num_bits = DEFAULT_NUM_BITS;
+  if (argc > 2) {
+    std::cerr << "Usage: bit-vector-bench [NUM_BITS]" << std::endl;
+    return 1;
+  } else if (argc == 2) {
+    num_bits = static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10));
+  }
+  std::cout << "#bits: " << num_bits << ", #queries: " << NUM_QUERIES
+            << std::endl;
+
+  std::mt19937_64 random;
+  std::vector<std::uint64_t> words(num_bits / 64);
+  for (std::size_t i = 0; i < words.size(); ++i) {
+    words[i] = random();
+  }
+
+  std::vector<std::size_t> pos(NUM_QUERIES);
+  for (std::size_t i = 0; i < pos.size(); ++i) {
+    pos[i] = random() % (num_bits + 1);
+  }
+
+  const struct {
+    const char *name;
+    int flags;
+  } layouts[] = {
+    { "pack", 0 },
+    { "line", MARISA2_CACHE_LINE_LAYOUT },
+    { "pack/64", MARISA2_SELECT_INTERVAL_64 },
+    { "pack/8192", MARISA2_SELECT_INTERVAL_8192 }
+  };
+
+  for (const auto &layout : layouts) {
+    marisa2::grimoire::BitVector bit_vector;
+    marisa2::Error error = bit_vector.push_back_words(words.data(),
+                                                      words.size());
+    if (!error) {
+      error = bit_vector.push_back_bits(random(), num_bits % 64);
+    }
+    if (!error) {
+      error = bit_vector.build(layout.flags | MARISA2_ENABLE_SELECT_1);
+    }
+    if (error) {
+      std::cerr << "error: " << error.message() << std::endl;
+      return 1;
+    }
+    std::cout << "layout: " << layout.name << std::endl;
+
+    const marisa2::grimoire::BitVector &v = bit_vector;
+    if (benchmark("rank_1", pos,
+            [&v](std::size_t i) { return v.rank_1(i); },
+            [&v](const std::size_t *args, std::size_t *out, std::size_t n) {
+              v.rank_1_batch(args, out, n);
+            }) != 0) {
+      return 1;
+    }
+
+    std::vector<std::size_t> ranks(NUM_QUERIES);
+    for (std::size_t i = 0; i < ranks.size(); ++i) {
+      ranks[i] = random() % v.num_1s();
+    }
+    if (benchmark("select_1", ranks,
+            [&v](std::size_t i) { return v.select_1(i); },
+            [&v](const std::size_t *args, std::size_t *out, std::size_t n) {
+              v.select_1_batch(args, out, n);
+            }) != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
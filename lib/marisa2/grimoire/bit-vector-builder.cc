@@ -0,0 +1,319 @@
+#include <limits>
+
+#include "bit-vector-builder.h"
+
+namespace marisa2 {
+namespace grimoire {
+namespace {
+
+// NUM_BUFFERED_BLOCKS is the number of blocks written at once.
+constexpr std::size_t NUM_BUFFERED_BLOCKS = 1024;
+
+}  // namespace
+
+BitVectorBuilder::BitVectorBuilder()
+  : writer_(nullptr), flags_(0), size_(0), num_1s_(0), unit_(0), units_(),
+    num_units_(0), num_blocks_(0), block_1s_(0), group_1s_(0), packs_(),
+    lines_(), bases_(), select_1s_(), select_0s_(), num_select_1s_(0),
+    num_select_0s_(0) {}
+
+BitVectorBuilder::~BitVectorBuilder() {}
+
+Error BitVectorBuilder::open(Writer &writer, int flags) {
+  if (writer_ != nullptr) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to open builder: already opened");
+  } else if ((flags & MARISA2_SELECT_INTERVAL_MASK) >
+             MARISA2_SELECT_INTERVAL_8192) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to open builder: invalid interval");
+  }
+
+  flags &= MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0 |
+      MARISA2_CACHE_LINE_LAYOUT | MARISA2_WIDE_INDEX |
+      MARISA2_SELECT_INTERVAL_MASK;
+  flags_ = flags | MARISA2_ENABLE_RANK;
+
+  Error error = (flags_ & MARISA2_CACHE_LINE_LAYOUT) ?
+      lines_.reserve(NUM_BUFFERED_BLOCKS) :
+      packs_.reserve(NUM_BUFFERED_BLOCKS);
+  if (error) {
+    clear();
+    return error;
+  }
+  writer_ = &writer;
+  return MARISA2_SUCCESS;
+}
+
+Error BitVectorBuilder::push_back_bits(std::uint64_t bits,
+                                       std::size_t num_bits) {
+  if (writer_ == nullptr) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to push bits: not opened");
+  }
+
+  if (num_bits > 64) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to push bits: num_bits > 64");
+  } else if (num_bits == 0) {
+    return MARISA2_SUCCESS;
+  }
+
+  if (num_bits > (std::numeric_limits<std::size_t>::max() - size_)) {
+    return MARISA2_ERROR(MARISA2_SIZE_ERROR, "failed to push bits: full");
+  } else if (!(flags_ & MARISA2_WIDE_INDEX) &&
+             ((size_ + num_bits) >= BitVector::MAX_NARROW_SIZE)) {
+    return MARISA2_ERROR(MARISA2_SIZE_ERROR,
+                         "failed to push bits: narrow index is full");
+  }
+
+  if (num_bits != 64) {
+    bits &= (std::uint64_t(1) << num_bits) - 1;
+  }
+
+  // The bits may fill unit_ and overflow into the next unit.
+  const std::size_t offset = size_ % 64;
+  unit_ |= bits << offset;
+  size_ += num_bits;
+  if ((offset + num_bits) >= 64) {
+    Error error = push_unit(unit_, 64);
+    if (error) {
+      return error;
+    }
+    unit_ = (offset != 0) ? (bits >> (64 - offset)) : 0;
+  }
+  return MARISA2_SUCCESS;
+}
+
+Error BitVectorBuilder::push_back_words(const std::uint64_t *words,
+                                        std::size_t num_words) {
+  if (writer_ == nullptr) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to push words: not opened");
+  }
+
+  if (num_words == 0) {
+    return MARISA2_SUCCESS;
+  } else if (words == nullptr) {
+    return MARISA2_ERROR(MARISA2_NULL_ERROR,
+                         "failed to push words: words == nullptr");
+  }
+
+  for (std::size_t i = 0; i < num_words; ++i) {
+    Error error = push_back_bits(words[i], 64);
+    if (error) {
+      return error;
+    }
+  }
+  return MARISA2_SUCCESS;
+}
+
+Error BitVectorBuilder::finish(BitVectorHeader *header) {
+  if (writer_ == nullptr) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to finish builder: not opened");
+  } else if (header == nullptr) {
+    return MARISA2_ERROR(MARISA2_NULL_ERROR,
+                         "failed to finish builder: header == nullptr");
+  }
+
+  // The last unit and the last block are padded with 0s, and then the
+  // sentinel block for rank_1/0(size()) follows.
+  if ((size_ % 64) != 0) {
+    Error error = push_unit(unit_, size_ % 64);
+    if (error) {
+      return error;
+    }
+  }
+  if (num_units_ != 0) {
+    Error error = push_block();
+    if (error) {
+      return error;
+    }
+  }
+  Error error = push_block();
+  if (error) {
+    return error;
+  }
+  error = flush_blocks();
+  if (error) {
+    return error;
+  }
+
+  if (flags_ & MARISA2_ENABLE_SELECT_1) {
+    error = push_select_hint(select_1s_, size_ / 64);
+    if (error) {
+      return error;
+    }
+  }
+  if (flags_ & MARISA2_ENABLE_SELECT_0) {
+    error = push_select_hint(select_0s_, size_ / 64);
+    if (error) {
+      return error;
+    }
+  }
+
+  if (flags_ & (MARISA2_CACHE_LINE_LAYOUT | MARISA2_WIDE_INDEX)) {
+    error = bases_.write(*writer_);
+    if (error) {
+      return error;
+    }
+  }
+  error = select_1s_.write(*writer_);
+  if (error) {
+    return error;
+  }
+  error = select_0s_.write(*writer_);
+  if (error) {
+    return error;
+  }
+
+  *header = BitVectorHeader{ size_, num_1s_,
+                             static_cast<std::uint64_t>(flags_) };
+  clear();
+  return MARISA2_SUCCESS;
+}
+
+Error BitVectorBuilder::push_unit(std::uint64_t unit, std::size_t num_bits) {
+  // Only valid 0s are sampled, and hints are set in the same way as
+  // BitVector::build().
+  const std::size_t unit_id = (num_blocks_ * num_units_per_block())
+      + num_units_;
+  const std::size_t num_1s = PopCount::pop_count(unit);
+  const std::size_t shift = BitVector::select_shift(flags_);
+  if (flags_ & MARISA2_ENABLE_SELECT_1) {
+    while ((num_select_1s_ << shift) < (num_1s_ + num_1s)) {
+      Error error = push_select_hint(select_1s_, unit_id);
+      if (error) {
+        return error;
+      }
+      ++num_select_1s_;
+    }
+  }
+  if (flags_ & MARISA2_ENABLE_SELECT_0) {
+    const std::size_t num_0s = (unit_id * 64) - num_1s_;
+    while ((num_select_0s_ << shift) < (num_0s + num_bits - num_1s)) {
+      Error error = push_select_hint(select_0s_, unit_id);
+      if (error) {
+        return error;
+      }
+      ++num_select_0s_;
+    }
+  }
+  num_1s_ += num_1s;
+
+  units_[num_units_++] = unit;
+  if (num_units_ == num_units_per_block()) {
+    return push_block();
+  }
+  return MARISA2_SUCCESS;
+}
+
+Error BitVectorBuilder::push_select_hint(Vector<std::uint32_t> &hints,
+                                         std::size_t unit_id) {
+  Error error = hints.push_back(static_cast<std::uint32_t>(unit_id));
+  if (error) {
+    return error;
+  }
+  if (flags_ & MARISA2_WIDE_INDEX) {
+    return hints.push_back(static_cast<std::uint32_t>(
+        static_cast<std::uint64_t>(unit_id) >> 32));
+  }
+  return MARISA2_SUCCESS;
+}
+
+Error BitVectorBuilder::push_block() {
+  // The ranks are relative to the group as BitVector::build_rank() and
+  // BitVector::build_lines() do.
+  const std::size_t block_id = num_blocks_++;
+  if (flags_ & MARISA2_CACHE_LINE_LAYOUT) {
+    if ((block_id % BitVector::LINES_PER_GROUP) == 0) {
+      group_1s_ = block_1s_;
+      Error error = bases_.push_back(group_1s_);
+      if (error) {
+        return error;
+      }
+    }
+    Line line;
+    line.rank = block_1s_ - group_1s_;
+    std::uint64_t count = 0;
+    for (std::size_t j = 0; j < 7; ++j) {
+      line.units[j] = units_[j];
+      line.rank |= count << ((BitVector::LINE_SHIFTS >> (j * 8)) & 0xFF);
+      count += PopCount::pop_count(units_[j]);
+    }
+    Error error = lines_.push_back(line);
+    if (error) {
+      return error;
+    }
+  } else {
+    if ((flags_ & MARISA2_WIDE_INDEX) &&
+        ((block_id % BitVector::PACKS_PER_GROUP) == 0)) {
+      group_1s_ = block_1s_;
+      Error error = bases_.push_back(group_1s_);
+      if (error) {
+        return error;
+      }
+    }
+    Pack pack;
+    std::size_t count = block_1s_ - group_1s_;
+    pack.rank.abs = static_cast<std::uint32_t>(count >> 6);
+    for (std::size_t j = 0; j < 4; ++j) {
+      pack.units[j] = units_[j];
+      pack.rank.rels[j] = static_cast<std::uint8_t>(
+          count - (static_cast<std::size_t>(pack.rank.abs) << 6));
+      count += PopCount::pop_count(units_[j]);
+    }
+    Error error = packs_.push_back(pack);
+    if (error) {
+      return error;
+    }
+  }
+
+  for (std::size_t j = 0; j < 7; ++j) {
+    units_[j] = 0;
+  }
+  num_units_ = 0;
+  block_1s_ = num_1s_;
+
+  if ((packs_.size() + lines_.size()) == NUM_BUFFERED_BLOCKS) {
+    return flush_blocks();
+  }
+  return MARISA2_SUCCESS;
+}
+
+Error BitVectorBuilder::flush_blocks() {
+  Error error = (flags_ & MARISA2_CACHE_LINE_LAYOUT) ?
+      lines_.write(*writer_) : packs_.write(*writer_);
+  if (error) {
+    return error;
+  }
+  packs_.resize(0);
+  lines_.resize(0);
+  return MARISA2_SUCCESS;
+}
+
+void BitVectorBuilder::clear() {
+  writer_ = nullptr;
+  flags_ = 0;
+  size_ = 0;
+  num_1s_ = 0;
+  unit_ = 0;
+  for (std::size_t j = 0; j < 7; ++j) {
+    units_[j] = 0;
+  }
+  num_units_ = 0;
+  num_blocks_ = 0;
+  block_1s_ = 0;
+  group_1s_ = 0;
+  packs_.clear();
+  lines_.clear();
+  bases_.clear();
+  select_1s_.clear();
+  select_0s_.clear();
+  num_select_1s_ = 0;
+  num_select_0s_ = 0;
+}
+
+}  // namespace grimoire
+}  // namespace marisa2
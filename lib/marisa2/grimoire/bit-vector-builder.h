@@ -0,0 +1,99 @@
+#ifndef MARISA2_GRIMOIRE_BIT_VECTOR_BUILDER_H
+#define MARISA2_GRIMOIRE_BIT_VECTOR_BUILDER_H
+
+#include "bit-vector.h"
+
+namespace marisa2 {
+namespace grimoire {
+
+// BitVectorBuilder writes a bit vector to a Writer without keeping its units
+// in memory. Blocks and their ranks are written as soon as they are filled,
+// and only the select hints and the group bases are kept until finish().
+// The output is the same as BitVector::write() after BitVector::build().
+class MARISA2_DLL_EXPORT BitVectorBuilder {
+ public:
+  BitVectorBuilder() noexcept;
+  ~BitVectorBuilder() noexcept;
+
+  BitVectorBuilder(const BitVectorBuilder &) = delete;
+  BitVectorBuilder &operator=(const BitVectorBuilder &) = delete;
+
+  explicit operator bool() const noexcept {
+    return writer_ != nullptr;
+  }
+
+  // open() starts writing a bit vector to writer, which must be alive until
+  // finish(). flags is the same as BitVector::build() except that
+  // MARISA2_WIDE_INDEX must be given for 2^38 bits or more, because ranks are
+  // written before the size is known.
+  Error open(Writer &writer, int flags = 0) noexcept;
+
+  Error push_back(bool bit) noexcept {
+    return push_back_bits(bit, 1);
+  }
+  Error push_back_bits(std::uint64_t bits, std::size_t num_bits) noexcept;
+  Error push_back_word(std::uint64_t word) noexcept {
+    return push_back_bits(word, 64);
+  }
+  Error push_back_words(const std::uint64_t *words,
+                        std::size_t num_words) noexcept;
+
+  // finish() writes the rest of the bit vector and stores its header into
+  // header, which is required to map or read the bit vector. Then, the
+  // builder is closed and can be opened again.
+  Error finish(BitVectorHeader *header) noexcept;
+
+  std::size_t size() const noexcept {
+    return size_;
+  }
+  std::size_t num_1s() const noexcept {
+    return num_1s_;
+  }
+
+ private:
+  using Pack = BitVector::Pack;
+  using Line = BitVector::Line;
+
+  Writer *writer_;
+  int flags_;
+  std::size_t size_;
+  std::size_t num_1s_;
+  // unit_ has the last bits that do not fill a unit.
+  std::uint64_t unit_;
+  // units_ has the units of the current block, and block_1s_ is the number
+  // of 1s in the preceding blocks.
+  std::uint64_t units_[7];
+  std::size_t num_units_;
+  std::size_t num_blocks_;
+  std::size_t block_1s_;
+  std::size_t group_1s_;
+  Vector<Pack> packs_;
+  Vector<Line> lines_;
+  Vector<std::uint64_t> bases_;
+  Vector<std::uint32_t> select_1s_;
+  Vector<std::uint32_t> select_0s_;
+  std::size_t num_select_1s_;
+  std::size_t num_select_0s_;
+
+  std::size_t num_units_per_block() const noexcept {
+    return (flags_ & MARISA2_CACHE_LINE_LAYOUT) ? 7 : 4;
+  }
+
+  // push_unit() appends a unit that has num_bits valid bits, and
+  // push_select_hint() appends a hint that points to unit_id.
+  Error push_unit(std::uint64_t unit, std::size_t num_bits) noexcept;
+  Error push_select_hint(Vector<std::uint32_t> &hints,
+                         std::size_t unit_id) noexcept;
+
+  // push_block() appends the current block to the buffer, and
+  // flush_blocks() writes the buffered blocks.
+  Error push_block() noexcept;
+  Error flush_blocks() noexcept;
+
+  void clear() noexcept;
+};
+
+}  // namespace grimoire
+}  // namespace marisa2
+
+#endif  // MARISA2_GRIMOIRE_BIT_VECTOR_BUILDER_H
@@ -1,12 +1,317 @@
+#ifdef _WIN32
+# ifndef NOMINMAX
+#  define NOMINMAX
+# endif  // NOMINMAX
+# include <windows.h>
+# include <process.h>
+#else  // _WIN32
+# include <pthread.h>
+#endif  // _WIN32
+
+#include <algorithm>
 #include <limits>
+#include <memory>
+#include <new>
+#include <thread>
+#include <utility>
 
 #include "bit-vector.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+# define MARISA2_HAS_AVX2_DISPATCH
+# include <cpuid.h>
+# include <immintrin.h>
+#endif  // defined(__x86_64__) && defined(__GNUC__)
+
 namespace marisa2 {
 namespace grimoire {
+namespace {
+
+// RANK_PREFETCH_DISTANCE is the number of positions prefetched in advance by
+// rank_1/0_batch(). It should cover the memory latency.
+constexpr std::size_t RANK_PREFETCH_DISTANCE = 16;
+
+// SELECT_BATCH_WIDTH is the number of queries interleaved by
+// select_1/0_batch().
+constexpr std::size_t SELECT_BATCH_WIDTH = 8;
+
+inline void prefetch(const void *address) noexcept {
+#ifdef __GNUC__
+  __builtin_prefetch(address);
+#else  // __GNUC__
+  static_cast<void>(address);
+#endif  // __GNUC__
+}
+
+// VALID_FLAGS has the flags that may appear in a header.
+constexpr int VALID_FLAGS = MARISA2_ENABLE_RANK | MARISA2_ENABLE_SELECT_1 |
+    MARISA2_ENABLE_SELECT_0 | MARISA2_CACHE_LINE_LAYOUT |
+    MARISA2_WIDE_INDEX | MARISA2_SELECT_INTERVAL_MASK;
+
+// is_valid_interval() returns whether the select interval in flags is one of
+// MARISA2_SELECT_INTERVAL_* or the default.
+inline bool is_valid_interval(std::uint64_t flags) noexcept {
+  return (flags & MARISA2_SELECT_INTERVAL_MASK) <=
+      std::uint64_t(MARISA2_SELECT_INTERVAL_8192);
+}
+
+// MAX_BUILD_THREADS is the maximum number of threads used by build(), and
+// MIN_BLOCKS_PER_THREAD avoids spawning threads for small bit vectors.
+constexpr std::size_t MAX_BUILD_THREADS = 256;
+constexpr std::size_t MIN_BLOCKS_PER_THREAD = 4096;
+
+// NUM_FILLED_PACKS is the number of packs filled at once by fill_rank(),
+// which are counted before they leave the L1 cache.
+constexpr std::size_t NUM_FILLED_PACKS = 64;
+
+// NoFill is a filler for build_index() that leaves the units as they are.
+struct NoFill {
+  void operator()(std::size_t, std::size_t) const noexcept {}
+};
+
+// chunk_size() returns the size of chunks to split num_items items for
+// num_threads threads. The size is a multiple of align so that a chunk does
+// not share a group of blocks with another chunk.
+inline std::size_t chunk_size(std::size_t num_items, std::size_t num_threads,
+                              std::size_t align) noexcept {
+  std::size_t size =
+      (num_items / num_threads) + ((num_items % num_threads) != 0);
+  size = std::max(size, MIN_BLOCKS_PER_THREAD);
+  return ((size / align) + ((size % align) != 0)) * align;
+}
+
+inline std::size_t num_chunks(std::size_t num_items,
+                              std::size_t chunk_size) noexcept {
+  return std::max<std::size_t>(
+      (num_items / chunk_size) + ((num_items % chunk_size) != 0), 1);
+}
+
+// A Worker runs (*f)(task_id) on its own thread.
+template <typename F>
+struct Worker {
+#ifdef _WIN32
+  HANDLE thread;
+#else  // _WIN32
+  pthread_t thread;
+#endif  // _WIN32
+  F *f;
+  std::size_t task_id;
+  bool started;
+};
+
+#ifdef _WIN32
+template <typename F>
+unsigned __stdcall run_worker(void *arg) noexcept {
+  Worker<F> *worker = static_cast<Worker<F> *>(arg);
+  (*worker->f)(worker->task_id);
+  return 0;
+}
+#else  // _WIN32
+template <typename F>
+void *run_worker(void *arg) noexcept {
+  Worker<F> *worker = static_cast<Worker<F> *>(arg);
+  (*worker->f)(worker->task_id);
+  return nullptr;
+}
+#endif  // _WIN32
+
+// start_worker() returns whether a thread for worker has been created.
+template <typename F>
+bool start_worker(Worker<F> &worker) noexcept {
+#ifdef _WIN32
+  worker.thread = reinterpret_cast<HANDLE>(
+      ::_beginthreadex(nullptr, 0, run_worker<F>, &worker, 0, nullptr));
+  return worker.thread != nullptr;
+#else  // _WIN32
+  return ::pthread_create(&worker.thread, nullptr,
+                          run_worker<F>, &worker) == 0;
+#endif  // _WIN32
+}
+
+template <typename F>
+void join_worker(Worker<F> &worker) noexcept {
+#ifdef _WIN32
+  ::WaitForSingleObject(worker.thread, INFINITE);
+  ::CloseHandle(worker.thread);
+#else  // _WIN32
+  ::pthread_join(worker.thread, nullptr);
+#endif  // _WIN32
+}
+
+// run_in_parallel() calls f(i) for i in [0, num_tasks) on different threads.
+// The last task runs on the calling thread. A failure of std::thread throws
+// an exception, which calls std::terminate() in this noexcept code, so
+// pthread_create() or _beginthreadex() is used instead. If a thread or its
+// storage cannot be created, its task runs on the calling thread.
+template <typename F>
+void run_in_parallel(std::size_t num_tasks, F f) noexcept {
+  const std::size_t num_workers = num_tasks - 1;
+  std::unique_ptr<Worker<F>[]> workers;
+  if (num_workers != 0) {
+    workers.reset(new (std::nothrow) Worker<F>[num_workers]);
+  }
+  for (std::size_t i = 0; i < num_workers; ++i) {
+    if (!workers) {
+      f(i);
+      continue;
+    }
+    Worker<F> &worker = workers[i];
+    worker.f = &f;
+    worker.task_id = i;
+    worker.started = start_worker(worker);
+    if (!worker.started) {
+      f(i);
+    }
+  }
+  f(num_tasks - 1);
+  for (std::size_t i = 0; workers && (i < num_workers); ++i) {
+    if (workers[i].started) {
+      join_worker(workers[i]);
+    }
+  }
+}
+
+// apply_op() returns the result of a bitwise operation of combine().
+template <int Op>
+inline std::uint64_t apply_op(std::uint64_t x, std::uint64_t y) noexcept {
+  return (Op == BitVector::BITWISE_AND) ? (x & y) :
+         (Op == BitVector::BITWISE_OR) ? (x | y) :
+         (Op == BitVector::BITWISE_XOR) ? (x ^ y) : (x & ~y);
+}
+
+inline std::uint64_t apply_op(int op, std::uint64_t x,
+                              std::uint64_t y) noexcept {
+  switch (op) {
+    case BitVector::BITWISE_AND: {
+      return apply_op<BitVector::BITWISE_AND>(x, y);
+    }
+    case BitVector::BITWISE_OR: {
+      return apply_op<BitVector::BITWISE_OR>(x, y);
+    }
+    case BitVector::BITWISE_XOR: {
+      return apply_op<BitVector::BITWISE_XOR>(x, y);
+    }
+    default: {
+      return apply_op<BitVector::BITWISE_ANDNOT>(x, y);
+    }
+  }
+}
+
+// combine_units() applies op to the 4 units of num_packs packs, where each
+// pack starts stride words after the previous one. AVX2 is used if the
+// running CPU supports it.
+template <int Op>
+void combine_units_scalar(const std::uint64_t *lhs, const std::uint64_t *rhs,
+                   std::uint64_t *out, std::size_t num_packs,
+                   std::size_t stride) noexcept {
+  for (std::size_t i = 0; i < num_packs; ++i) {
+    for (std::size_t j = 0; j < 4; ++j) {
+      out[j] = apply_op<Op>(lhs[j], rhs[j]);
+    }
+    lhs += stride;
+    rhs += stride;
+    out += stride;
+  }
+}
+
+#ifdef MARISA2_HAS_AVX2_DISPATCH
+// The 4 units of a pack fit in a 256-bit register.
+template <int Op>
+__attribute__((target("avx2")))
+void combine_units_avx2(const std::uint64_t *lhs, const std::uint64_t *rhs,
+                        std::uint64_t *out, std::size_t num_packs,
+                        std::size_t stride) noexcept {
+  for (std::size_t i = 0; i < num_packs; ++i) {
+    const __m256i x =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lhs));
+    const __m256i y =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rhs));
+    const __m256i z = (Op == BitVector::BITWISE_AND) ? _mm256_and_si256(x, y) :
+        (Op == BitVector::BITWISE_OR) ? _mm256_or_si256(x, y) :
+        (Op == BitVector::BITWISE_XOR) ? _mm256_xor_si256(x, y) :
+        _mm256_andnot_si256(y, x);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), z);
+    lhs += stride;
+    rhs += stride;
+    out += stride;
+  }
+}
+
+// YMM registers must be enabled by the OS as well as supported by the CPU.
+bool detect_avx2() noexcept {
+  unsigned int eax, ebx, ecx, edx;
+  if (::__get_cpuid_max(0, nullptr) < 7) {
+    return false;
+  }
+  __cpuid(1, eax, ebx, ecx, edx);
+  if (((ecx & bit_OSXSAVE) == 0) || ((ecx & bit_AVX) == 0)) {
+    return false;
+  }
+  unsigned int xcr0_low, xcr0_high;
+  __asm__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+  if ((xcr0_low & 0x06) != 0x06) {
+    return false;
+  }
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return (ebx & bit_AVX2) != 0;
+}
+
+const bool uses_avx2 = detect_avx2();
+#endif  // MARISA2_HAS_AVX2_DISPATCH
+
+template <int Op>
+void combine_units(const std::uint64_t *lhs, const std::uint64_t *rhs,
+                   std::uint64_t *out, std::size_t num_packs,
+                   std::size_t stride) noexcept {
+#ifdef MARISA2_HAS_AVX2_DISPATCH
+  if (uses_avx2) {
+    combine_units_avx2<Op>(lhs, rhs, out, num_packs, stride);
+    return;
+  }
+#endif  // MARISA2_HAS_AVX2_DISPATCH
+  combine_units_scalar<Op>(lhs, rhs, out, num_packs, stride);
+}
+
+inline void combine_units(int op, const std::uint64_t *lhs,
+                          const std::uint64_t *rhs, std::uint64_t *out,
+                          std::size_t num_packs, std::size_t stride) noexcept {
+  switch (op) {
+    case BitVector::BITWISE_AND: {
+      combine_units<BitVector::BITWISE_AND>(lhs, rhs, out, num_packs,
+                                            stride);
+      break;
+    }
+    case BitVector::BITWISE_OR: {
+      combine_units<BitVector::BITWISE_OR>(lhs, rhs, out, num_packs,
+                                           stride);
+      break;
+    }
+    case BitVector::BITWISE_XOR: {
+      combine_units<BitVector::BITWISE_XOR>(lhs, rhs, out, num_packs,
+                                            stride);
+      break;
+    }
+    default: {
+      combine_units<BitVector::BITWISE_ANDNOT>(lhs, rhs, out, num_packs,
+                                               stride);
+      break;
+    }
+  }
+}
+
+}  // namespace
+
+constexpr std::size_t BitVector::PACKS_PER_GROUP;
+constexpr std::uint64_t BitVector::MAX_NARROW_SIZE;
+constexpr std::size_t BitVector::NUM_SCAN_UNITS;
+constexpr std::size_t BitVector::LINE_SIZE;
+constexpr std::size_t BitVector::LINES_PER_GROUP;
+constexpr std::uint64_t BitVector::LINE_SHIFTS;
+constexpr std::uint64_t BitVector::LINE_WIDTHS;
 
 BitVector::BitVector()
-  : packs_(), size_(0), num_1s_(0), flags_(0), select_1s_(), select_0s_() {}
+  : packs_(), lines_(), bases_(), size_(0), num_1s_(0), flags_(0),
+    select_1s_(), select_0s_(), lazy_flags_(0), lazy_mutex_() {}
 
 BitVector::~BitVector() {}
 
@@ -24,22 +329,52 @@ Error BitVector::map(Mapper &mapper, const BitVectorHeader &header) {
   const std::size_t new_num_1s = static_cast<std::size_t>(header.num_1s);
   const std::size_t new_num_0s = new_size - new_num_1s;
 
-  if (header.flags == 0) {
+  if (!(header.flags & MARISA2_ENABLE_RANK) ||
+      (header.flags & ~std::uint64_t(VALID_FLAGS)) ||
+      !is_valid_interval(header.flags) ||
+      (!(header.flags & MARISA2_WIDE_INDEX) &&
+       (header.size >= MAX_NARROW_SIZE))) {
     return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
                          "failed to map bit vector: invalid flags");
   }
 
   Vector<Pack> new_packs;
-  Error error = new_packs.map(mapper,
-      VectorHeader{ (new_size / 256) + ((new_size % 256 != 0)) + 1 });
-  if (error) {
-    return error;
+  Vector<Line> new_lines;
+  Vector<std::uint64_t> new_bases;
+  if (header.flags & MARISA2_CACHE_LINE_LAYOUT) {
+    const std::size_t num_units = (new_size / 64) + ((new_size % 64) != 0);
+    const std::size_t num_lines = (num_units / 7) + ((num_units % 7) != 0) + 1;
+    Error error = new_lines.map(mapper, VectorHeader{ num_lines });
+    if (error) {
+      return error;
+    }
+    error = new_bases.map(mapper, VectorHeader{ (num_lines / LINES_PER_GROUP)
+        + ((num_lines % LINES_PER_GROUP) != 0) });
+    if (error) {
+      return error;
+    }
+  } else {
+    const std::size_t num_packs =
+        (new_size / 256) + ((new_size % 256 != 0)) + 1;
+    Error error = new_packs.map(mapper, VectorHeader{ num_packs });
+    if (error) {
+      return error;
+    }
+    if (header.flags & MARISA2_WIDE_INDEX) {
+      error = new_bases.map(mapper, VectorHeader{ (num_packs / PACKS_PER_GROUP)
+          + ((num_packs % PACKS_PER_GROUP) != 0) });
+      if (error) {
+        return error;
+      }
+    }
   }
 
+  const int new_flags = static_cast<int>(header.flags);
+
   Vector<std::uint32_t> new_select_1s;
   if (header.flags & MARISA2_ENABLE_SELECT_1) {
     Error error = new_select_1s.map(mapper,
-        VectorHeader{ (new_num_1s / 256) + ((new_num_1s % 256) != 0) + 1 });
+        VectorHeader{ num_select_hints(new_num_1s, new_flags) });
     if (error) {
       return error;
     }
@@ -48,22 +383,123 @@ Error BitVector::map(Mapper &mapper, const BitVectorHeader &header) {
   Vector<std::uint32_t> new_select_0s;
   if (header.flags & MARISA2_ENABLE_SELECT_0) {
     Error error = new_select_0s.map(mapper,
-        VectorHeader{ (new_num_0s / 256) + ((new_num_0s % 256) != 0) + 1 });
+        VectorHeader{ num_select_hints(new_num_0s, new_flags) });
     if (error) {
       return error;
     }
   }
 
-  // TODO
-
-  size_ = new_size;
-  num_1s_ = new_num_1s;
-  flags_ = static_cast<int>(header.flags);
+  // The mapped sections are installed only after all of them are mapped
+  // and the rank of the sentinel block matches the header.
+  BitVector new_bit_vector;
+  new_bit_vector.packs_.swap(new_packs);
+  new_bit_vector.lines_.swap(new_lines);
+  new_bit_vector.bases_.swap(new_bases);
+  new_bit_vector.size_ = new_size;
+  new_bit_vector.num_1s_ = new_num_1s;
+  new_bit_vector.flags_ = new_flags;
+  new_bit_vector.select_1s_.swap(new_select_1s);
+  new_bit_vector.select_0s_.swap(new_select_0s);
+  if (new_bit_vector.rank_block_1(new_bit_vector.num_blocks())
+      != new_num_1s) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to map bit vector: invalid ranks");
+  }
+  swap(new_bit_vector);
   return MARISA2_SUCCESS;
 }
 
 Error BitVector::read(Reader &reader, const BitVectorHeader &header) {
-  // TODO
+  if (header.size > std::numeric_limits<std::size_t>::max()) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to read bit vector: too large");
+  }
+  const std::size_t new_size = static_cast<std::size_t>(header.size);
+
+  if (header.num_1s > header.size) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to read bit vector: invalid num_1s");
+  }
+  const std::size_t new_num_1s = static_cast<std::size_t>(header.num_1s);
+  const std::size_t new_num_0s = new_size - new_num_1s;
+
+  if (!(header.flags & MARISA2_ENABLE_RANK) ||
+      (header.flags & ~std::uint64_t(VALID_FLAGS)) ||
+      !is_valid_interval(header.flags) ||
+      (!(header.flags & MARISA2_WIDE_INDEX) &&
+       (header.size >= MAX_NARROW_SIZE))) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to read bit vector: invalid flags");
+  }
+
+  Vector<Pack> new_packs;
+  Vector<Line> new_lines;
+  Vector<std::uint64_t> new_bases;
+  if (header.flags & MARISA2_CACHE_LINE_LAYOUT) {
+    const std::size_t num_units = (new_size / 64) + ((new_size % 64) != 0);
+    const std::size_t num_lines = (num_units / 7) + ((num_units % 7) != 0) + 1;
+    Error error = new_lines.read(reader, VectorHeader{ num_lines });
+    if (error) {
+      return error;
+    }
+    error = new_bases.read(reader, VectorHeader{ (num_lines / LINES_PER_GROUP)
+        + ((num_lines % LINES_PER_GROUP) != 0) });
+    if (error) {
+      return error;
+    }
+  } else {
+    const std::size_t num_packs =
+        (new_size / 256) + ((new_size % 256 != 0)) + 1;
+    Error error = new_packs.read(reader, VectorHeader{ num_packs });
+    if (error) {
+      return error;
+    }
+    if (header.flags & MARISA2_WIDE_INDEX) {
+      error = new_bases.read(reader, VectorHeader{ (num_packs / PACKS_PER_GROUP)
+          + ((num_packs % PACKS_PER_GROUP) != 0) });
+      if (error) {
+        return error;
+      }
+    }
+  }
+
+  const int new_flags = static_cast<int>(header.flags);
+
+  Vector<std::uint32_t> new_select_1s;
+  if (header.flags & MARISA2_ENABLE_SELECT_1) {
+    Error error = new_select_1s.read(reader,
+        VectorHeader{ num_select_hints(new_num_1s, new_flags) });
+    if (error) {
+      return error;
+    }
+  }
+
+  Vector<std::uint32_t> new_select_0s;
+  if (header.flags & MARISA2_ENABLE_SELECT_0) {
+    Error error = new_select_0s.read(reader,
+        VectorHeader{ num_select_hints(new_num_0s, new_flags) });
+    if (error) {
+      return error;
+    }
+  }
+
+  // The sections are installed only after all of them are read and the rank
+  // of the sentinel block matches the header.
+  BitVector new_bit_vector;
+  new_bit_vector.packs_.swap(new_packs);
+  new_bit_vector.lines_.swap(new_lines);
+  new_bit_vector.bases_.swap(new_bases);
+  new_bit_vector.size_ = new_size;
+  new_bit_vector.num_1s_ = new_num_1s;
+  new_bit_vector.flags_ = new_flags;
+  new_bit_vector.select_1s_.swap(new_select_1s);
+  new_bit_vector.select_0s_.swap(new_select_0s);
+  if (new_bit_vector.rank_block_1(new_bit_vector.num_blocks())
+      != new_num_1s) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to read bit vector: invalid ranks");
+  }
+  swap(new_bit_vector);
   return MARISA2_SUCCESS;
 }
 
@@ -73,12 +509,29 @@ Error BitVector::write(Writer &writer) {
                          "failed to write bit vector: not fixed");
   }
 
-  Error error = packs_.write(writer);
-  if (error) {
-    return error;
+  if (flags_ & MARISA2_CACHE_LINE_LAYOUT) {
+    Error error = lines_.write(writer);
+    if (error) {
+      return error;
+    }
+    error = bases_.write(writer);
+    if (error) {
+      return error;
+    }
+  } else {
+    Error error = packs_.write(writer);
+    if (error) {
+      return error;
+    }
+    if (flags_ & MARISA2_WIDE_INDEX) {
+      error = bases_.write(writer);
+      if (error) {
+        return error;
+      }
+    }
   }
 
-  error = select_1s_.write(writer);
+  Error error = select_1s_.write(writer);
   if (error) {
     return error;
   }
@@ -91,16 +544,32 @@ Error BitVector::write(Writer &writer) {
   return MARISA2_SUCCESS;
 }
 
-Error BitVector::push_back(bool bit) noexcept {
-  if (flags_ != 0) {
-    return MARISA2_ERROR(MARISA2_STATE_ERROR,
-                         "failed to push bit: already fixed");
-  }
+void BitVector::swap(BitVector &rhs) {
+  packs_.swap(rhs.packs_);
+  lines_.swap(rhs.lines_);
+  bases_.swap(rhs.bases_);
+  std::swap(size_, rhs.size_);
+  std::swap(num_1s_, rhs.num_1s_);
+  std::swap(flags_, rhs.flags_);
+  select_1s_.swap(rhs.select_1s_);
+  select_0s_.swap(rhs.select_0s_);
+  const int lazy_flags = lazy_flags_.load(std::memory_order_relaxed);
+  lazy_flags_.store(rhs.lazy_flags_.load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+  rhs.lazy_flags_.store(lazy_flags, std::memory_order_relaxed);
+}
 
+Error BitVector::push_back(bool bit) noexcept {
   if (size_ == std::numeric_limits<std::size_t>::max()) {
     return MARISA2_ERROR(MARISA2_SIZE_ERROR, "failed to push bit: full");
   }
 
+  if (flags_ != 0) {
+    return append(1, [this, bit]() {
+      or_unit(size_ / 64, std::uint64_t(bit) << (size_ % 64));
+    });
+  }
+
   if (size_ == (packs_.size() * 256)) {
     Error error = packs_.push_back(
         Pack{ { 0, 0, 0, 0 }, { 0, { 0, 0, 0, 0 } } });
@@ -115,20 +584,200 @@ Error BitVector::push_back(bool bit) noexcept {
   return MARISA2_SUCCESS;
 }
 
-Error BitVector::build(int flags) {
+Error BitVector::push_back_bits(std::uint64_t bits, std::size_t num_bits) {
+  if (num_bits > 64) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to push bits: num_bits > 64");
+  } else if (num_bits == 0) {
+    return MARISA2_SUCCESS;
+  }
+
+  if (num_bits > (std::numeric_limits<std::size_t>::max() - size_)) {
+    return MARISA2_ERROR(MARISA2_SIZE_ERROR, "failed to push bits: full");
+  }
+
+  if (num_bits != 64) {
+    bits &= (std::uint64_t(1) << num_bits) - 1;
+  }
+
+  if (flags_ != 0) {
+    return append(num_bits, [this, bits, num_bits]() {
+      const std::size_t unit_id = size_ / 64;
+      const std::size_t offset = size_ % 64;
+      or_unit(unit_id, bits << offset);
+      if ((offset + num_bits) > 64) {
+        or_unit(unit_id + 1, bits >> (64 - offset));
+      }
+    });
+  }
+
+  Error error = resize_packs(size_ + num_bits);
+  if (error) {
+    return error;
+  }
+
+  // The bits may straddle two units, which may be in different packs.
+  const std::size_t unit_id = size_ / 64;
+  const std::size_t offset = size_ % 64;
+  packs_[unit_id / 4].units[unit_id % 4] |= bits << offset;
+  if ((offset + num_bits) > 64) {
+    packs_[(unit_id + 1) / 4].units[(unit_id + 1) % 4] |=
+        bits >> (64 - offset);
+  }
+  size_ += num_bits;
+  return MARISA2_SUCCESS;
+}
+
+Error BitVector::push_back_words(const std::uint64_t *words,
+                                 std::size_t num_words) {
+  if (num_words == 0) {
+    return MARISA2_SUCCESS;
+  } else if (words == nullptr) {
+    return MARISA2_ERROR(MARISA2_NULL_ERROR,
+                         "failed to push words: words == nullptr");
+  }
+
+  if (num_words > ((std::numeric_limits<std::size_t>::max() - size_) / 64)) {
+    return MARISA2_ERROR(MARISA2_SIZE_ERROR, "failed to push words: full");
+  }
+
+  if (flags_ != 0) {
+    return append(num_words * 64, [this, words, num_words]() {
+      const std::size_t unit_id = size_ / 64;
+      const std::size_t offset = size_ % 64;
+      for (std::size_t i = 0; i < num_words; ++i) {
+        or_unit(unit_id + i, words[i] << offset);
+        if (offset != 0) {
+          or_unit(unit_id + i + 1, words[i] >> (64 - offset));
+        }
+      }
+    });
+  }
+
+  Error error = resize_packs(size_ + (num_words * 64));
+  if (error) {
+    return error;
+  }
+
+  std::size_t unit_id = size_ / 64;
+  const std::size_t offset = size_ % 64;
+  if (offset == 0) {
+    for (std::size_t i = 0; i < num_words; ++i, ++unit_id) {
+      packs_[unit_id / 4].units[unit_id % 4] = words[i];
+    }
+  } else {
+    for (std::size_t i = 0; i < num_words; ++i, ++unit_id) {
+      packs_[unit_id / 4].units[unit_id % 4] |= words[i] << offset;
+      packs_[(unit_id + 1) / 4].units[(unit_id + 1) % 4] =
+          words[i] >> (64 - offset);
+    }
+  }
+  size_ += num_words * 64;
+  return MARISA2_SUCCESS;
+}
+
+Error BitVector::build(int flags, std::size_t num_threads) {
   if (flags_ != 0) {
     return MARISA2_ERROR(MARISA2_STATE_ERROR,
                          "failed to push bit: already fixed");
+  } else if (!is_valid_interval(flags)) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to build bit vector: invalid interval");
+  }
+  return build_index(flags, num_threads, NoFill());
+}
+
+Error BitVector::combine(const BitVector &lhs, const BitVector &rhs, int op,
+                         int flags, std::size_t num_threads) {
+  if ((flags_ != 0) || (size_ != 0)) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to combine bit vectors: not empty");
+  } else if ((op < BITWISE_AND) || (op > BITWISE_ANDNOT)) {
+    return MARISA2_ERROR(MARISA2_CODE_ERROR,
+                         "failed to combine bit vectors: invalid op");
+  } else if (lhs.size_ != rhs.size_) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to combine bit vectors: size mismatch");
+  } else if (!is_valid_interval(flags)) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to combine bit vectors: invalid interval");
   }
 
-  Error error = build_rank();
+  // The units of the result are filled by build_index(), so that they are
+  // counted while they are in the cache. The packs of lhs and rhs are read
+  // directly unless they are in the cache line layout.
+  BitVector result;
+  Error error = result.resize_packs(lhs.size_);
+  if (error) {
+    return error;
+  }
+  result.size_ = lhs.size_;
+  const std::size_t num_packs = result.packs_.size();
+  const bool direct = !(lhs.flags_ & MARISA2_CACHE_LINE_LAYOUT) &&
+      !(rhs.flags_ & MARISA2_CACHE_LINE_LAYOUT);
+  error = result.build_index(flags, num_threads,
+      [&lhs, &rhs, &result, op, num_packs, direct](std::size_t begin,
+                                                   std::size_t end) {
+    end = std::min(end, num_packs);
+    if (begin >= end) {
+      return;
+    } else if (direct) {
+      combine_units(op, lhs.packs_[begin].units, rhs.packs_[begin].units,
+                    result.packs_[begin].units, end - begin,
+                    sizeof(Pack) / sizeof(std::uint64_t));
+      return;
+    }
+    for (std::size_t i = begin * 4; i < (end * 4); ++i) {
+      result.packs_[i / 4].units[i % 4] =
+          apply_op(op, lhs.unit(i), rhs.unit(i));
+    }
+  });
   if (error) {
     return error;
   }
-  flags_ |= MARISA2_ENABLE_RANK;
+  swap(result);
+  return MARISA2_SUCCESS;
+}
+
+template <typename F>
+Error BitVector::build_index(int flags, std::size_t num_threads,
+                             F fill_units) noexcept {
+  if (num_threads == 0) {
+    num_threads = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+  }
+  num_threads = std::min(num_threads, MAX_BUILD_THREADS);
+
+  // The wide index is chosen if counters or hints may overflow.
+  const bool wide = (flags & MARISA2_WIDE_INDEX) ||
+      (static_cast<std::uint64_t>(size_) >= MAX_NARROW_SIZE);
+
+  if (flags & MARISA2_CACHE_LINE_LAYOUT) {
+    // The packs are filled before they are copied into lines.
+    const std::size_t num_packs = packs_.size();
+    const std::size_t size = chunk_size(num_packs, num_threads, 1);
+    run_in_parallel(num_chunks(num_packs, size),
+                    [num_packs, size, &fill_units](std::size_t i) {
+      fill_units(i * size, std::min(num_packs, (i + 1) * size));
+    });
+    Error error = build_lines(num_threads);
+    if (error) {
+      return error;
+    }
+    flags_ |= MARISA2_ENABLE_RANK | MARISA2_CACHE_LINE_LAYOUT;
+  } else {
+    Error error = build_rank(wide, num_threads, fill_units);
+    if (error) {
+      return error;
+    }
+    flags_ |= MARISA2_ENABLE_RANK;
+  }
+  if (wide) {
+    flags_ |= MARISA2_WIDE_INDEX;
+  }
+  flags_ |= flags & MARISA2_SELECT_INTERVAL_MASK;
 
   if (flags & MARISA2_ENABLE_SELECT_1) {
-    Error error = build_select_1();
+    Error error = build_select_1(num_threads);
     if (error) {
       return error;
     }
@@ -136,7 +785,7 @@ Error BitVector::build(int flags) {
   }
 
   if (flags & MARISA2_ENABLE_SELECT_0) {
-    Error error = build_select_0();
+    Error error = build_select_0(num_threads);
     if (error) {
       return error;
     }
@@ -146,17 +795,476 @@ Error BitVector::build(int flags) {
   return MARISA2_SUCCESS;
 }
 
+Error BitVector::enable_select(int flags, bool lazy) {
+  if (flags_ == 0) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to enable select: not fixed");
+  }
+
+  // The indices that already exist are skipped. A lazy index that is not
+  // built yet is built now unless lazy is true.
+  flags &= MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0;
+  flags &= ~static_cast<int>(header().flags);
+  if (lazy) {
+    lazy_flags_.fetch_or(flags, std::memory_order_release);
+    return MARISA2_SUCCESS;
+  }
+  lazy_flags_.fetch_and(~flags, std::memory_order_relaxed);
+
+  if (flags & MARISA2_ENABLE_SELECT_1) {
+    Error error = build_select_1(1);
+    if (error) {
+      select_1s_.clear();
+      return error;
+    }
+    flags_ |= MARISA2_ENABLE_SELECT_1;
+  }
+
+  if (flags & MARISA2_ENABLE_SELECT_0) {
+    Error error = build_select_0(1);
+    if (error) {
+      select_0s_.clear();
+      return error;
+    }
+    flags_ |= MARISA2_ENABLE_SELECT_0;
+  }
+
+  return MARISA2_SUCCESS;
+}
+
+BitVectorHeader BitVector::header() const {
+  // A lazy index is written by write() only after it is built.
+  int flags = flags_;
+  const int lazy_flags = lazy_flags_.load(std::memory_order_acquire);
+  if (!(lazy_flags & MARISA2_ENABLE_SELECT_1) && (select_1s_.size() != 0)) {
+    flags |= MARISA2_ENABLE_SELECT_1;
+  }
+  if (!(lazy_flags & MARISA2_ENABLE_SELECT_0) && (select_0s_.size() != 0)) {
+    flags |= MARISA2_ENABLE_SELECT_0;
+  }
+  return BitVectorHeader{ size_, num_1s_, static_cast<std::uint64_t>(flags) };
+}
+
+void BitVector::rank_1_batch(const std::size_t *pos, std::size_t *out,
+                             std::size_t n) const {
+  const std::size_t num_prefetches =
+      (n < RANK_PREFETCH_DISTANCE) ? n : RANK_PREFETCH_DISTANCE;
+  for (std::size_t i = 0; i < num_prefetches; ++i) {
+    prefetch_rank(pos[i]);
+  }
+  for (std::size_t i = 0; i < n; ++i) {
+    if ((i + RANK_PREFETCH_DISTANCE) < n) {
+      prefetch_rank(pos[i + RANK_PREFETCH_DISTANCE]);
+    }
+    out[i] = rank_1(pos[i]);
+  }
+}
+
+void BitVector::rank_0_batch(const std::size_t *pos, std::size_t *out,
+                             std::size_t n) const {
+  rank_1_batch(pos, out, n);
+  for (std::size_t i = 0; i < n; ++i) {
+    out[i] = pos[i] - out[i];
+  }
+}
+
 std::size_t BitVector::select_1(std::size_t i) const {
-  // TODO
-  return i;
+  // The (i + 1)-th 1 lies between the units pointed to by adjacent hints.
+  // All the blocks are searched if a lazy build of hints has failed.
+  const Vector<std::uint32_t> &hints = select_hints<true>();
+  std::size_t begin = 0;
+  std::size_t end = num_blocks() - 1;
+  if (hints.size() != 0) {
+    const std::size_t select_id = i >> select_shift(flags_);
+    begin = unit_id_to_block_id(select_hint(hints, select_id));
+    end = unit_id_to_block_id(select_hint(hints, select_id + 1));
+  }
+
+  // Find the last block in [begin, end] whose rank is not greater than i.
+  // A short range is scanned linearly, because adjacent blocks are likely to
+  // share cache lines.
+  while ((begin + 8) < end) {
+    const std::size_t middle = (begin + end + 1) / 2;
+    if (rank_block_1(middle) <= i) {
+      begin = middle;
+    } else {
+      end = middle - 1;
+    }
+  }
+  while ((begin < end) && (rank_block_1(begin + 1) <= i)) {
+    ++begin;
+  }
+  return select_in_block_1(begin, i);
 }
 
 std::size_t BitVector::select_0(std::size_t i) const {
-  // TODO
-  return i;
+  // The (i + 1)-th 0 lies between the units pointed to by adjacent hints.
+  const Vector<std::uint32_t> &hints = select_hints<false>();
+  std::size_t begin = 0;
+  std::size_t end = num_blocks() - 1;
+  if (hints.size() != 0) {
+    const std::size_t select_id = i >> select_shift(flags_);
+    begin = unit_id_to_block_id(select_hint(hints, select_id));
+    end = unit_id_to_block_id(select_hint(hints, select_id + 1));
+  }
+
+  // Find the last block in [begin, end] whose rank is not greater than i.
+  while ((begin + 8) < end) {
+    const std::size_t middle = (begin + end + 1) / 2;
+    if (rank_block_0(middle) <= i) {
+      begin = middle;
+    } else {
+      end = middle - 1;
+    }
+  }
+  while ((begin < end) && (rank_block_0(begin + 1) <= i)) {
+    ++begin;
+  }
+  return select_in_block_0(begin, i);
+}
+
+void BitVector::select_1_batch(const std::size_t *ranks, std::size_t *out,
+                               std::size_t n) const {
+  select_batch<true>(ranks, out, n);
+}
+
+void BitVector::select_0_batch(const std::size_t *ranks, std::size_t *out,
+                               std::size_t n) const {
+  select_batch<false>(ranks, out, n);
+}
+
+std::size_t BitVector::next_1(std::size_t i) const {
+  if (i >= size_) {
+    return size_;
+  }
+  // Bits after size_ are 0s and never found.
+  std::size_t unit_id = i / 64;
+  std::uint64_t x = unit(unit_id) & (~std::uint64_t(0) << (i % 64));
+  const std::size_t num_units = (size_ + 63) / 64;
+  const std::size_t scan_end = ((flags_ != 0) &&
+      ((num_units - unit_id) > NUM_SCAN_UNITS)) ?
+      (unit_id + NUM_SCAN_UNITS) : num_units;
+  while (x == 0) {
+    if (++unit_id == scan_end) {
+      if (unit_id == num_units) {
+        return size_;
+      }
+      const std::size_t rank = rank_unit_1(unit_id);
+      return (rank < num_1s_) ? select_1(rank) : size_;
+    }
+    x = unit(unit_id);
+  }
+  return (unit_id * 64) + SelectBit::lowest_bit(x);
+}
+
+std::size_t BitVector::next_0(std::size_t i) const {
+  if (i >= size_) {
+    return size_;
+  }
+  // Bits after size_ are 0s, so a result must be compared with size_.
+  std::size_t unit_id = i / 64;
+  std::uint64_t x = ~unit(unit_id) & (~std::uint64_t(0) << (i % 64));
+  const std::size_t num_units = (size_ + 63) / 64;
+  const std::size_t scan_end = ((flags_ != 0) &&
+      ((num_units - unit_id) > NUM_SCAN_UNITS)) ?
+      (unit_id + NUM_SCAN_UNITS) : num_units;
+  while (x == 0) {
+    if (++unit_id == scan_end) {
+      if (unit_id == num_units) {
+        return size_;
+      }
+      const std::size_t rank = rank_unit_0(unit_id);
+      return (rank < num_0s()) ? select_0(rank) : size_;
+    }
+    x = ~unit(unit_id);
+  }
+  const std::size_t pos = (unit_id * 64) + SelectBit::lowest_bit(x);
+  return (pos < size_) ? pos : size_;
+}
+
+std::size_t BitVector::prev_1(std::size_t i) const {
+  if (size_ == 0) {
+    return size_;
+  } else if (i >= size_) {
+    i = size_ - 1;
+  }
+  std::size_t unit_id = i / 64;
+  std::uint64_t x = unit(unit_id) & (~std::uint64_t(0) >> (63 - (i % 64)));
+  const std::size_t scan_end = ((flags_ != 0) &&
+      (unit_id > NUM_SCAN_UNITS)) ? (unit_id - NUM_SCAN_UNITS) : 0;
+  while (x == 0) {
+    if (unit_id == scan_end) {
+      if (unit_id == 0) {
+        return size_;
+      }
+      const std::size_t rank = rank_unit_1(unit_id);
+      return (rank != 0) ? select_1(rank - 1) : size_;
+    }
+    x = unit(--unit_id);
+  }
+  return (unit_id * 64) + SelectBit::highest_bit(x);
 }
 
-Error BitVector::build_rank() noexcept {
+std::size_t BitVector::prev_0(std::size_t i) const {
+  if (size_ == 0) {
+    return size_;
+  } else if (i >= size_) {
+    i = size_ - 1;
+  }
+  std::size_t unit_id = i / 64;
+  std::uint64_t x = ~unit(unit_id) & (~std::uint64_t(0) >> (63 - (i % 64)));
+  const std::size_t scan_end = ((flags_ != 0) &&
+      (unit_id > NUM_SCAN_UNITS)) ? (unit_id - NUM_SCAN_UNITS) : 0;
+  while (x == 0) {
+    if (unit_id == scan_end) {
+      if (unit_id == 0) {
+        return size_;
+      }
+      const std::size_t rank = rank_unit_0(unit_id);
+      return (rank != 0) ? select_0(rank - 1) : size_;
+    }
+    x = ~unit(--unit_id);
+  }
+  return (unit_id * 64) + SelectBit::highest_bit(x);
+}
+
+std::size_t BitVector::select_in_block_1(std::size_t block_id,
+                                         std::size_t i) const noexcept {
+  if (flags_ & MARISA2_CACHE_LINE_LAYOUT) {
+    return (block_id * LINE_SIZE) + select_in_line_1(lines_[block_id],
+        i - static_cast<std::size_t>(bases_[block_id / LINES_PER_GROUP]));
+  }
+  const Pack &pack = packs_[block_id];
+  return (block_id * 256) + select_in_pack_1(pack, i - pack_base(block_id)
+      - (static_cast<std::size_t>(pack.rank.abs) << 6));
+}
+
+std::size_t BitVector::select_in_block_0(std::size_t block_id,
+                                         std::size_t i) const noexcept {
+  if (flags_ & MARISA2_CACHE_LINE_LAYOUT) {
+    return (block_id * LINE_SIZE)
+        + select_in_line_0(lines_[block_id], i - rank_block_0(block_id));
+  }
+  return (block_id * 256)
+      + select_in_pack_0(packs_[block_id], i - rank_block_0(block_id));
+}
+
+// select_batch() runs up to SELECT_BATCH_WIDTH queries at once in the style
+// of asynchronous memory access chaining (AMAC). Each query is a state
+// machine, and each step issues a prefetch for the next step and moves on to
+// another query instead of waiting for the memory.
+template <bool Bit>
+void BitVector::select_batch(const std::size_t *ranks, std::size_t *out,
+                             std::size_t n) const {
+  enum Stage { STAGE_DONE, STAGE_HINT, STAGE_SEARCH, STAGE_SCAN };
+  struct State {
+    Stage stage;
+    std::size_t query_id;
+    std::size_t begin;
+    std::size_t end;
+    std::size_t middle;
+  };
+
+  const Vector<std::uint32_t> &hints = select_hints<Bit>();
+  if (hints.size() == 0) {
+    for (std::size_t i = 0; i < n; ++i) {
+      out[i] = Bit ? select_1(ranks[i]) : select_0(ranks[i]);
+    }
+    return;
+  }
+  const std::size_t hint_id_scale = (flags_ & MARISA2_WIDE_INDEX) ? 2 : 1;
+  const std::size_t shift = select_shift(flags_);
+
+  State states[SELECT_BATCH_WIDTH];
+  std::size_t num_queries = 0;
+  std::size_t num_active_states = 0;
+  for (State &state : states) {
+    state.stage = STAGE_DONE;
+    if (num_queries < n) {
+      state.stage = STAGE_HINT;
+      state.query_id = num_queries++;
+      prefetch(&hints[(ranks[state.query_id] >> shift) * hint_id_scale]);
+      ++num_active_states;
+    }
+  }
+
+  while (num_active_states != 0) {
+    for (State &state : states) {
+      if (state.stage == STAGE_DONE) {
+        continue;
+      }
+
+      const std::size_t i = ranks[state.query_id];
+      if (state.stage == STAGE_HINT) {
+        state.begin = unit_id_to_block_id(select_hint(hints, i >> shift));
+        state.end = unit_id_to_block_id(select_hint(hints, (i >> shift) + 1));
+      } else if (state.stage == STAGE_SEARCH) {
+        const std::size_t rank = Bit ? rank_block_1(state.middle)
+                                     : rank_block_0(state.middle);
+        if (rank <= i) {
+          state.begin = state.middle;
+        } else {
+          state.end = state.middle - 1;
+        }
+      } else {
+        while ((state.begin < state.end) &&
+               ((Bit ? rank_block_1(state.begin + 1)
+                     : rank_block_0(state.begin + 1)) <= i)) {
+          ++state.begin;
+        }
+        out[state.query_id] = Bit ? select_in_block_1(state.begin, i)
+                                  : select_in_block_0(state.begin, i);
+
+        // The finished state is reused for the next query.
+        if (num_queries < n) {
+          state.stage = STAGE_HINT;
+          state.query_id = num_queries++;
+          prefetch(&hints[(ranks[state.query_id] >> shift) * hint_id_scale]);
+        } else {
+          state.stage = STAGE_DONE;
+          --num_active_states;
+        }
+        continue;
+      }
+
+      // The same binary search as select_1/0() is split into steps.
+      if ((state.begin + 8) < state.end) {
+        state.stage = STAGE_SEARCH;
+        state.middle = (state.begin + state.end + 1) / 2;
+        prefetch_block(state.middle);
+      } else {
+        state.stage = STAGE_SCAN;
+        for (std::size_t j = state.begin; j <= state.end; ++j) {
+          prefetch_block(j);
+        }
+      }
+    }
+  }
+}
+
+void BitVector::prefetch_block(std::size_t block_id) const noexcept {
+  if (flags_ & MARISA2_CACHE_LINE_LAYOUT) {
+    prefetch(&lines_[block_id]);
+    prefetch(&bases_[block_id / LINES_PER_GROUP]);
+  } else {
+    const Pack &pack = packs_[block_id];
+    prefetch(&pack.units[0]);
+    prefetch(&pack.rank);
+    if (flags_ & MARISA2_WIDE_INDEX) {
+      prefetch(&bases_[block_id / PACKS_PER_GROUP]);
+    }
+  }
+}
+
+void BitVector::prefetch_rank(std::size_t i) const noexcept {
+  if (flags_ & MARISA2_CACHE_LINE_LAYOUT) {
+    prefetch(&lines_[i / LINE_SIZE]);
+    prefetch(&bases_[i / (LINE_SIZE * LINES_PER_GROUP)]);
+  } else {
+    // A pack may straddle cache lines, so both the unit and the rank are
+    // prefetched.
+    const Pack &pack = packs_[i / 256];
+    prefetch(&pack.units[(i / 64) % 4]);
+    prefetch(&pack.rank);
+    if (flags_ & MARISA2_WIDE_INDEX) {
+      prefetch(&bases_[(i / 256) / PACKS_PER_GROUP]);
+    }
+  }
+}
+
+Error BitVector::resize_packs(std::size_t num_bits) noexcept {
+  const std::size_t num_packs = (num_bits / 256) + ((num_bits % 256) != 0);
+  if (num_packs <= packs_.size()) {
+    return MARISA2_SUCCESS;
+  }
+  return packs_.resize(num_packs,
+                       Pack{ { 0, 0, 0, 0 }, { 0, { 0, 0, 0, 0 } } });
+}
+
+template <typename F>
+Error BitVector::append(std::size_t num_bits, F write_units) noexcept {
+  if (is_mapped()) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to append bits: mapped");
+  }
+  const std::size_t new_size = size_ + num_bits;
+  if (!(flags_ & MARISA2_WIDE_INDEX) &&
+      (static_cast<std::uint64_t>(new_size) >= MAX_NARROW_SIZE)) {
+    return MARISA2_ERROR(MARISA2_SIZE_ERROR,
+                         "failed to append bits: too large for narrow index");
+  }
+
+  // The select hints are reserved for the case where all the new bits are
+  // 1s or 0s.
+  const bool line_layout = (flags_ & MARISA2_CACHE_LINE_LAYOUT) != 0;
+  const bool wide = (flags_ & MARISA2_WIDE_INDEX) != 0;
+  const std::size_t num_units = (new_size / 64) + ((new_size % 64) != 0);
+  const std::size_t new_num_blocks = line_layout ?
+      ((num_units / 7) + ((num_units % 7) != 0) + 1) :
+      ((new_size / 256) + ((new_size % 256) != 0) + 1);
+  const std::size_t group_size =
+      line_layout ? LINES_PER_GROUP : PACKS_PER_GROUP;
+  const std::size_t num_groups = (new_num_blocks / group_size)
+      + ((new_num_blocks % group_size) != 0);
+  Error error = line_layout ?
+      lines_.reserve(new_num_blocks) : packs_.reserve(new_num_blocks);
+  if (error) {
+    return error;
+  }
+  if (line_layout || wide) {
+    error = bases_.reserve(num_groups);
+    if (error) {
+      return error;
+    }
+  }
+  if (select_1s_.size() != 0) {
+    error = select_1s_.reserve(num_select_hints(num_1s_ + num_bits, flags_));
+    if (error) {
+      return error;
+    }
+  }
+  if (select_0s_.size() != 0) {
+    error = select_0s_.reserve(num_select_hints(num_0s() + num_bits, flags_));
+    if (error) {
+      return error;
+    }
+  }
+
+  // The blocks from the one that has the old end are ranked again. The
+  // blocks before it and their select hints are not changed.
+  const std::size_t begin = unit_id_to_block_id(size_ / 64);
+  const std::size_t count = rank_block_1(begin);
+  if (line_layout) {
+    lines_.resize(new_num_blocks, Line{ { 0, 0, 0, 0, 0, 0, 0 }, 0 });
+    bases_.resize(num_groups);
+  } else {
+    packs_.resize(new_num_blocks,
+                  Pack{ { 0, 0, 0, 0 }, { 0, { 0, 0, 0, 0 } } });
+    if (wide) {
+      bases_.resize(num_groups);
+    }
+  }
+  write_units();
+  size_ = new_size;
+  if (line_layout) {
+    fill_lines(begin, lines_.size(), count);
+    num_1s_ = rank_block_1(num_blocks());
+  } else {
+    num_1s_ = fill_rank(begin, packs_.size(), count, wide, NoFill());
+  }
+
+  if (select_1s_.size() != 0) {
+    extend_select_hints<true>(begin);
+  }
+  if (select_0s_.size() != 0) {
+    extend_select_hints<false>(begin);
+  }
+  return MARISA2_SUCCESS;
+}
+
+template <typename F>
+Error BitVector::build_rank(bool wide, std::size_t num_threads,
+                            F fill_units) noexcept {
   Error error = packs_.push_back(
       Pack{ { 0, 0, 0, 0 }, { 0, { 0, 0, 0, 0 } } });
   if (error) {
@@ -165,55 +1273,241 @@ Error BitVector::build_rank() noexcept {
 
   packs_.shrink();
 
-  for (std::size_t i = 0; i < packs_.size(); ++i) {
-    Pack &pack = packs_[i];
-    pack.rank.abs = static_cast<std::uint32_t>(num_1s_ >> 6);
-    for (std::size_t j = 0; j < 4; ++j) {
-      pack.rank.rels[j] = static_cast<std::uint8_t>(
-          num_1s_ - (static_cast<std::size_t>(pack.rank.abs) << 6));
-      num_1s_ += PopCount::pop_count(pack.units[j]);
+  if (wide) {
+    error = bases_.resize((packs_.size() / PACKS_PER_GROUP)
+        + ((packs_.size() % PACKS_PER_GROUP) != 0));
+    if (error) {
+      return error;
     }
   }
 
+  // Each chunk fills and counts its units, and then fills its ranks from the
+  // prefix sum of the counts. A single chunk does both in one pass. A chunk
+  // in the wide index mode consists of whole groups.
+  const std::size_t size =
+      chunk_size(packs_.size(), num_threads, wide ? PACKS_PER_GROUP : 1);
+  const std::size_t num_tasks = num_chunks(packs_.size(), size);
+  if (num_tasks == 1) {
+    num_1s_ = fill_rank(0, packs_.size(), 0, wide, fill_units);
+    return MARISA2_SUCCESS;
+  }
+
+  std::size_t counts[MAX_BUILD_THREADS] = {};
+  run_in_parallel(num_tasks,
+                  [this, size, &counts, &fill_units](std::size_t i) {
+    const std::size_t end = std::min(packs_.size(), (i + 1) * size);
+    fill_units(i * size, end);
+    for (std::size_t j = i * size; j < end; ++j) {
+      for (std::size_t k = 0; k < 4; ++k) {
+        counts[i] += PopCount::pop_count(packs_[j].units[k]);
+      }
+    }
+  });
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < num_tasks; ++i) {
+    count += counts[i];
+    counts[i] = count - counts[i];
+  }
+  run_in_parallel(num_tasks,
+                  [this, wide, size, num_tasks, &counts](std::size_t i) {
+    const std::size_t end = std::min(packs_.size(), (i + 1) * size);
+    const std::size_t count =
+        fill_rank(i * size, end, counts[i], wide, NoFill());
+    if ((i + 1) == num_tasks) {
+      num_1s_ = count;
+    }
+  });
   return MARISA2_SUCCESS;
 }
 
-Error BitVector::build_select_1() noexcept {
-  Error error = select_1s_.resize(
-      (num_1s_ / 256) + ((num_1s_ % 256) != 0) + 1);
+template <typename F>
+std::size_t BitVector::fill_rank(std::size_t begin, std::size_t end,
+                                 std::size_t count, bool wide,
+                                 F fill_units) noexcept {
+  // In the wide index mode, counters are relative to the group. begin may
+  // be in the middle of a group if bits are appended after build().
+  std::size_t base = (wide && ((begin % PACKS_PER_GROUP) != 0)) ?
+      static_cast<std::size_t>(bases_[begin / PACKS_PER_GROUP]) : 0;
+  for (std::size_t i = begin; i < end; ++i) {
+    if (((i - begin) % NUM_FILLED_PACKS) == 0) {
+      fill_units(i, std::min(end, i + NUM_FILLED_PACKS));
+    }
+    if (wide && ((i % PACKS_PER_GROUP) == 0)) {
+      base = count;
+      bases_[i / PACKS_PER_GROUP] = base;
+    }
+    Pack &pack = packs_[i];
+    pack.rank.abs = static_cast<std::uint32_t>((count - base) >> 6);
+    for (std::size_t j = 0; j < 4; ++j) {
+      pack.rank.rels[j] = static_cast<std::uint8_t>(count - base
+          - (static_cast<std::size_t>(pack.rank.abs) << 6));
+      count += PopCount::pop_count(pack.units[j]);
+    }
+  }
+  return count;
+}
+
+Error BitVector::build_lines(std::size_t num_threads) noexcept {
+  // The last line is a sentinel for rank_1/0(size()).
+  const std::size_t num_units = (size_ / 64) + ((size_ % 64) != 0);
+  const std::size_t num_lines = (num_units / 7) + ((num_units % 7) != 0) + 1;
+  Error error = lines_.resize(num_lines, Line{ { 0, 0, 0, 0, 0, 0, 0 }, 0 });
+  if (error) {
+    return error;
+  }
+  error = bases_.resize((num_lines / LINES_PER_GROUP)
+      + ((num_lines % LINES_PER_GROUP) != 0));
   if (error) {
     return error;
   }
 
+  // Each chunk copies its units and counts its 1s, and then fills its ranks
+  // from the prefix sum of the counts.
+  const std::size_t size =
+      chunk_size(num_lines, num_threads, LINES_PER_GROUP);
+  const std::size_t num_tasks = num_chunks(num_lines, size);
+  std::size_t counts[MAX_BUILD_THREADS] = {};
+  run_in_parallel(num_tasks,
+                  [this, num_units, size, &counts](std::size_t i) {
+    const std::size_t end = std::min(num_units, (i + 1) * size * 7);
+    for (std::size_t j = i * size * 7; j < end; ++j) {
+      lines_[j / 7].units[j % 7] = packs_[j / 4].units[j % 4];
+      counts[i] += PopCount::pop_count(lines_[j / 7].units[j % 7]);
+    }
+  });
+  packs_.clear();
+
   std::size_t count = 0;
-  for (std::size_t i = 0; i < size_; ++i) {
-    if ((*this)[i]) {
-      if ((count++ % 256) == 0) {
-        select_1s_[count / 256] = static_cast<std::uint32_t>(i >> 6);
-      }
+  for (std::size_t i = 0; i < num_tasks; ++i) {
+    count += counts[i];
+    counts[i] = count - counts[i];
+  }
+  num_1s_ = count;
+  run_in_parallel(num_tasks, [this, size, &counts](std::size_t i) {
+    fill_lines(i * size, std::min(lines_.size(), (i + 1) * size), counts[i]);
+  });
+  return MARISA2_SUCCESS;
+}
+
+void BitVector::fill_lines(std::size_t begin, std::size_t end,
+                           std::size_t count) noexcept {
+  for (std::size_t i = begin; i < end; ++i) {
+    if ((i % LINES_PER_GROUP) == 0) {
+      bases_[i / LINES_PER_GROUP] = count;
     }
+    Line &line = lines_[i];
+    line.rank = count - bases_[i / LINES_PER_GROUP];
+    std::uint64_t rel = 0;
+    for (std::size_t j = 0; j < 7; ++j) {
+      line.rank |= rel << ((LINE_SHIFTS >> (j * 8)) & 0xFF);
+      rel += PopCount::pop_count(line.units[j]);
+    }
+    count += static_cast<std::size_t>(rel);
   }
-  select_1s_.back() = size_ >> 6;
+}
+
+Error BitVector::build_select_1(std::size_t num_threads) noexcept {
+  const std::size_t shift = select_shift(flags_);
+  const std::size_t num_samples = (num_1s_ >> shift)
+      + ((num_1s_ & ((std::size_t(1) << shift) - 1)) != 0);
+  Error error = select_1s_.resize(num_select_hints(num_1s_, flags_));
+  if (error) {
+    return error;
+  }
+
+  // Each chunk of blocks sets the hints for the 1s in it.
+  const std::size_t end = num_blocks();
+  const std::size_t size = chunk_size(end, num_threads, 1);
+  run_in_parallel(num_chunks(end, size), [this, end, size](std::size_t i) {
+    fill_select_hints<true>(i * size, std::min(end, (i + 1) * size));
+  });
+  set_select_hint(select_1s_, num_samples, size_ / 64);
   return MARISA2_SUCCESS;
 }
 
-Error BitVector::build_select_0() noexcept {
-  Error error = select_0s_.resize(
-      (num_0s() / 256) + ((num_0s() % 256) != 0) + 1);
+Error BitVector::build_select_0(std::size_t num_threads) noexcept {
+  const std::size_t shift = select_shift(flags_);
+  const std::size_t num_samples = (num_0s() >> shift)
+      + ((num_0s() & ((std::size_t(1) << shift) - 1)) != 0);
+  Error error = select_0s_.resize(num_select_hints(num_0s(), flags_));
   if (error) {
     return error;
   }
 
-  std::size_t count = 0;
-  for (std::size_t i = 0; i < size_; ++i) {
-    if (!(*this)[i]) {
-      if ((count++ % 256) == 0) {
-        select_0s_[count / 256] = static_cast<std::uint32_t>(i >> 6);
+  const std::size_t end = num_blocks();
+  const std::size_t size = chunk_size(end, num_threads, 1);
+  run_in_parallel(num_chunks(end, size), [this, end, size](std::size_t i) {
+    fill_select_hints<false>(i * size, std::min(end, (i + 1) * size));
+  });
+  set_select_hint(select_0s_, num_samples, size_ / 64);
+  return MARISA2_SUCCESS;
+}
+
+void BitVector::build_lazy_select(int flag) const noexcept {
+  std::lock_guard<std::mutex> lock(lazy_mutex_);
+  if (lazy_flags_.load(std::memory_order_relaxed) & flag) {
+    // Only the lazy index is modified, and no other thread reads it until
+    // lazy_flags_ is updated. A failed build leaves the index empty.
+    BitVector *self = const_cast<BitVector *>(this);
+    Error error = (flag == MARISA2_ENABLE_SELECT_1) ?
+        self->build_select_1(1) : self->build_select_0(1);
+    if (error) {
+      ((flag == MARISA2_ENABLE_SELECT_1) ?
+          self->select_1s_ : self->select_0s_).clear();
+    }
+    lazy_flags_.fetch_and(~flag, std::memory_order_release);
+  }
+}
+
+template <bool Bit>
+void BitVector::fill_select_hints(std::size_t begin,
+                                  std::size_t end) noexcept {
+  // The hints for the (i << shift)-th 1/0s in [begin, end) are set. Blocks are
+  // skipped by using the rank directory, and only the blocks that have a
+  // sampled 1/0 are scanned unit by unit.
+  // 0s after the last bit are never sampled because all the sampled 0s are
+  // followed by valid 0s or themselves are the last valid 0.
+  Vector<std::uint32_t> &hints = Bit ? select_1s_ : select_0s_;
+  const std::size_t num_bits = Bit ? num_1s_ : num_0s();
+  const std::size_t begin_rank =
+      Bit ? rank_block_1(begin) : rank_block_0(begin);
+  const std::size_t end_rank =
+      std::min(Bit ? rank_block_1(end) : rank_block_0(end), num_bits);
+  const std::size_t shift = select_shift(flags_);
+  const std::size_t mask = (std::size_t(1) << shift) - 1;
+  std::size_t select_id = (begin_rank >> shift) + ((begin_rank & mask) != 0);
+  const std::size_t end_id = (end_rank >> shift) + ((end_rank & mask) != 0);
+
+  const std::size_t num_units = num_units_per_block();
+  for (std::size_t block_id = begin; select_id < end_id; ++block_id) {
+    const std::size_t next_rank = Bit ?
+        rank_block_1(block_id + 1) : rank_block_0(block_id + 1);
+    if (next_rank <= (select_id << shift)) {
+      continue;
+    }
+    std::size_t count = Bit ? rank_block_1(block_id) : rank_block_0(block_id);
+    for (std::size_t j = 0; j < num_units; ++j) {
+      const std::size_t unit_id = (block_id * num_units) + j;
+      const std::size_t pop_count = PopCount::pop_count(unit(unit_id));
+      count += Bit ? pop_count : (64 - pop_count);
+      while ((select_id < end_id) && (count > (select_id << shift))) {
+        set_select_hint(hints, select_id++, unit_id);
       }
     }
   }
-  select_0s_.back() = size_ >> 6;
-  return MARISA2_SUCCESS;
+}
+
+template <bool Bit>
+void BitVector::extend_select_hints(std::size_t begin) noexcept {
+  // The hints before begin are still valid, and the last hint is replaced.
+  Vector<std::uint32_t> &hints = Bit ? select_1s_ : select_0s_;
+  const std::size_t num_bits = Bit ? num_1s_ : num_0s();
+  const std::size_t shift = select_shift(flags_);
+  const std::size_t num_samples = (num_bits >> shift)
+      + ((num_bits & ((std::size_t(1) << shift) - 1)) != 0);
+  hints.resize(num_select_hints(num_bits, flags_));
+  fill_select_hints<Bit>(begin, num_blocks());
+  set_select_hint(hints, num_samples, size_ / 64);
 }
 
 }  // namespace grimoire
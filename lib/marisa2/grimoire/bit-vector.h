@@ -1,14 +1,45 @@
 #ifndef MARISA2_GRIMOIRE_BIT_VECTOR_H
 #define MARISA2_GRIMOIRE_BIT_VECTOR_H
 
+#include <atomic>
+#include <mutex>
+
 #include "pop-count.h"
+#include "select-bit.h"
 #include "vector.h"
 
-// These flags are used to build indices for select_1/0().
+// These flags are used to build indices for select_1/0() and to choose the
+// layout of a bit vector.
 enum {
-  MARISA2_ENABLE_RANK     = 1 << 0,
-  MARISA2_ENABLE_SELECT_1 = 1 << 1,
-  MARISA2_ENABLE_SELECT_0 = 1 << 2
+  MARISA2_ENABLE_RANK       = 1 << 0,
+  MARISA2_ENABLE_SELECT_1   = 1 << 1,
+  MARISA2_ENABLE_SELECT_0   = 1 << 2,
+
+  // MARISA2_CACHE_LINE_LAYOUT stores 448 bits and their rank counters in
+  // each 64-byte line, so that rank_1/0() touch only one cache line. The
+  // lines of a built or read bit vector are 64-byte aligned. map() uses the
+  // lines in place, so they are aligned only if the image places them on a
+  // 64-byte boundary. BitVector::is_aligned() tells which is the case.
+  // Otherwise, 256 bits and their counters are stored in each 40-byte pack.
+  MARISA2_CACHE_LINE_LAYOUT = 1 << 3,
+
+  // MARISA2_WIDE_INDEX uses 64-bit counters and select hints, which are
+  // required for bit vectors of 2^38 bits or more. build() enables it
+  // automatically for such a large bit vector.
+  MARISA2_WIDE_INDEX        = 1 << 4,
+
+  // MARISA2_SELECT_INTERVAL_* choose the number of 1/0s per select hint.
+  // A shorter interval makes select_1/0() faster and the hints larger. The
+  // default interval is 256.
+  MARISA2_SELECT_INTERVAL_64   = 1 << 8,
+  MARISA2_SELECT_INTERVAL_128  = 2 << 8,
+  MARISA2_SELECT_INTERVAL_256  = 3 << 8,
+  MARISA2_SELECT_INTERVAL_512  = 4 << 8,
+  MARISA2_SELECT_INTERVAL_1024 = 5 << 8,
+  MARISA2_SELECT_INTERVAL_2048 = 6 << 8,
+  MARISA2_SELECT_INTERVAL_4096 = 7 << 8,
+  MARISA2_SELECT_INTERVAL_8192 = 8 << 8,
+  MARISA2_SELECT_INTERVAL_MASK = 15 << 8
 };
 
 namespace marisa2 {
@@ -41,32 +72,165 @@ class MARISA2_DLL_EXPORT BitVector {
   Error read(Reader &reader, const BitVectorHeader &header) noexcept;
   Error write(Writer &writer) noexcept;
 
+  void swap(BitVector &rhs) noexcept;
+
+  // push_back() appends a bit. Bits can also be appended after build()
+  // unless the bit vector is mapped. Then, only the ranks of the blocks from
+  // the old end and the select hints for the new 1/0s are updated, so that
+  // the cost is linear in the number of appended bits.
   Error push_back(bool bit) noexcept;
 
-  // MARISA2_ENABLE_SELECT_1/0 are avaiable.
+  // push_back_bits() appends the lower num_bits bits of bits, where num_bits
+  // must be in [0, 64]. The bits are appended from the least significant bit.
+  // push_back_words() appends num_words units at once. These functions write
+  // units directly and are much faster than repeated push_back()s.
+  Error push_back_bits(std::uint64_t bits, std::size_t num_bits) noexcept;
+  Error push_back_word(std::uint64_t word) noexcept {
+    return push_back_bits(word, 64);
+  }
+  Error push_back_words(const std::uint64_t *words,
+                        std::size_t num_words) noexcept;
+
+  // MARISA2_ENABLE_SELECT_1/0, MARISA2_CACHE_LINE_LAYOUT,
+  // MARISA2_WIDE_INDEX, and MARISA2_SELECT_INTERVAL_* are avaiable.
   // MARISA2_ENABLE_RANK is implicitly enabled even if omitted.
-  Error build(int flags = 0) noexcept;
+  // build() uses up to num_threads threads for a large bit vector, and all
+  // the hardware threads if num_threads is 0. The result does not depend on
+  // num_threads.
+  Error build(int flags = 0, std::size_t num_threads = 1) noexcept;
+
+  enum {
+    BITWISE_AND    = 0,
+    BITWISE_OR     = 1,
+    BITWISE_XOR    = 2,
+    BITWISE_ANDNOT = 3
+  };
+
+  // combine() builds the result of op for lhs and rhs, which must have the
+  // same size, with flags and num_threads as build(). op is one of
+  // BITWISE_AND, BITWISE_OR, BITWISE_XOR, and BITWISE_ANDNOT (lhs & ~rhs).
+  // This bit vector must be empty, and lhs and rhs may or may not be built.
+  // Units are combined and ranked in one pass if possible.
+  Error combine(const BitVector &lhs, const BitVector &rhs, int op,
+                int flags = 0, std::size_t num_threads = 1) noexcept;
+
+  // enable_select() adds the select indices for ENABLE_SELECT_1/0 in flags
+  // to a built, mapped, or read bit vector that lacks them. The indices are
+  // built in heap memory even if the bit vector is mapped. If lazy is true,
+  // each index is built on the first select_1/0() call instead, which is
+  // safe even if several threads call select_1/0() at the same time.
+  Error enable_select(int flags, bool lazy = false) noexcept;
 
   bool operator[](std::size_t i) const noexcept {
-    return (reinterpret_cast<const std::uint64_t *>(&*packs_.begin())
-        [(i / 64) + (i / 256)] >> (i % 64)) & 1;
+    return (unit(i / 64) >> (i % 64)) & 1;
+  }
+
+  // get_bits() returns len bits starting at pos, where len must be in
+  // [0, 64] and (pos + len) must not be greater than size(). The bit at pos
+  // is the least significant bit of the result.
+  std::uint64_t get_bits(std::size_t pos, std::size_t len) const noexcept {
+    if (len == 0) {
+      return 0;
+    }
+    const std::size_t unit_id = pos / 64;
+    const std::size_t offset = pos % 64;
+    std::uint64_t bits = unit(unit_id) >> offset;
+    if ((offset + len) > 64) {
+      bits |= unit(unit_id + 1) << (64 - offset);
+    }
+    return (len == 64) ? bits : (bits & ((std::uint64_t(1) << len) - 1));
   }
 
   // rank_1/0()s are available after build().
   std::size_t rank_1(std::size_t i) const noexcept {
+    if (flags_ & MARISA2_CACHE_LINE_LAYOUT) {
+      const Line &line = lines_[i / LINE_SIZE];
+      const std::size_t j = (i / 64) % 7;
+      return bases_[i / (LINE_SIZE * LINES_PER_GROUP)] + line_rank(line, j)
+          + PopCount::pop_count((line.units[j] << 1) << (63 - (i % 64)));
+    }
     const Pack &pack = packs_[i / 256];
     const std::size_t j = (i / 64) % 4;
-    return (static_cast<std::size_t>(pack.rank.abs) << 6) + pack.rank.rels[j]
+    return pack_base(i / 256) + (static_cast<std::size_t>(pack.rank.abs) << 6)
+        + pack.rank.rels[j]
         + PopCount::pop_count((pack.units[j] << 1) << (63 - (i % 64)));
   }
   std::size_t rank_0(std::size_t i) const noexcept {
     return i - rank_1(i);
   }
 
+  // count_1/0() return the number of 1/0s in [i, j), where i <= j. They are
+  // available after build() unless i and j are in the same unit.
+  std::size_t count_1(std::size_t i, std::size_t j) const noexcept {
+    if ((i / 64) == (j / 64)) {
+      // The bits in [i, j) are in one unit.
+      const std::uint64_t mask = ~std::uint64_t(0) << (i % 64);
+      return PopCount::pop_count(
+          unit(i / 64) & mask & ((std::uint64_t(1) << (j % 64)) - 1));
+    }
+    return rank_1(j) - rank_1(i);
+  }
+  std::size_t count_0(std::size_t i, std::size_t j) const noexcept {
+    return (j - i) - count_1(i, j);
+  }
+
+  // rank_1/0_batch() store rank_1/0(pos[i]) into out[i] for i in [0, n).
+  // They prefetch blocks for upcoming positions while computing earlier ones,
+  // so that the latency of independent random accesses overlaps.
+  void rank_1_batch(const std::size_t *pos, std::size_t *out,
+                    std::size_t n) const noexcept;
+  void rank_0_batch(const std::size_t *pos, std::size_t *out,
+                    std::size_t n) const noexcept;
+
   // select_1/0()s are available after build() with ENABLE_SELECT_1/0.
+  // Adjacent hints give the range of blocks that has the (i + 1)-th 1/0. A
+  // binary search narrows the range down to 8 blocks, which are scanned,
+  // and the bit is selected in the last block whose rank is not greater
+  // than i. Only the binary search reads scattered cache lines, and their
+  // number is logarithmic in the number of blocks between the hints.
   std::size_t select_1(std::size_t i) const noexcept;
   std::size_t select_0(std::size_t i) const noexcept;
 
+  // select_1/0_batch() store select_1/0(ranks[i]) into out[i] for i in
+  // [0, n). Several queries are interleaved so that their cache misses
+  // overlap.
+  void select_1_batch(const std::size_t *ranks, std::size_t *out,
+                      std::size_t n) const noexcept;
+  void select_0_batch(const std::size_t *ranks, std::size_t *out,
+                      std::size_t n) const noexcept;
+
+  // next_1/0() return the position of the first 1/0 in [i, size()), and
+  // prev_1/0() return the position of the last 1/0 in [0, i]. They return
+  // size() if there is no such bit. A few units around i are scanned first,
+  // and rank_1/0() and select_1/0() are used for a longer gap after build(),
+  // whether or not the select hints are available. Before build(), units are
+  // scanned.
+  std::size_t next_1(std::size_t i) const noexcept;
+  std::size_t next_0(std::size_t i) const noexcept;
+  std::size_t prev_1(std::size_t i) const noexcept;
+  std::size_t prev_0(std::size_t i) const noexcept;
+
+  // for_each_1/0() call f(pos) for the positions of 1/0s in [begin, end) in
+  // ascending order, where begin <= end <= size(). Units are scanned and
+  // each 1/0 is taken from the lowest bit, so that the cost is linear in the
+  // length of the range. They are available before build().
+  template <typename F>
+  void for_each_1(std::size_t begin, std::size_t end, F f) const {
+    for_each<true>(begin, end, f);
+  }
+  template <typename F>
+  void for_each_0(std::size_t begin, std::size_t end, F f) const {
+    for_each<false>(begin, end, f);
+  }
+  template <typename F>
+  void for_each_1(F f) const {
+    for_each<true>(0, size_, f);
+  }
+  template <typename F>
+  void for_each_0(F f) const {
+    for_each<false>(0, size_, f);
+  }
+
   std::size_t size() const noexcept {
     return size_;
   }
@@ -80,11 +244,25 @@ class MARISA2_DLL_EXPORT BitVector {
   int flags() const noexcept {
     return flags_;
   }
-  BitVectorHeader header() const noexcept {
-    return BitVectorHeader{ size_, num_1s_, flags_ };
+  // is_mapped() returns whether any section is in memory given by map().
+  bool is_mapped() const noexcept {
+    return packs_.is_mapped() || lines_.is_mapped() || bases_.is_mapped() ||
+        select_1s_.is_mapped() || select_0s_.is_mapped();
+  }
+  // is_aligned() returns whether the lines of MARISA2_CACHE_LINE_LAYOUT
+  // start on a 64-byte boundary. It returns true for the other layout.
+  bool is_aligned() const noexcept {
+    return !(flags_ & MARISA2_CACHE_LINE_LAYOUT) ||
+        ((reinterpret_cast<std::uintptr_t>(lines_.begin()) % 64) == 0);
   }
+  // header() includes ENABLE_SELECT_1/0 for the lazy select indices only
+  // after they are built.
+  BitVectorHeader header() const noexcept;
 
  private:
+  friend class BitVectorBuilder;
+  template <int Flags> friend class FixedBitVector;
+
   struct Rank {
     std::uint32_t abs;
     std::uint8_t rels[4];
@@ -95,16 +273,296 @@ class MARISA2_DLL_EXPORT BitVector {
     Rank rank;
   };
 
+  // A line has 448 bits and fits in a 64-byte cache line. Its rank is packed
+  // into 64 bits: the lower 14 bits are the number of 1s in the preceding
+  // lines in the same group, and the upper 50 bits are the numbers of 1s in
+  // the preceding units in the line for units[1-6], whose widths are 7, 8,
+  // 8, 9, 9, and 9 bits respectively. bases_[i] is the number of 1s in the
+  // preceding groups, each of which has LINES_PER_GROUP lines.
+  struct Line {
+    std::uint64_t units[7];
+    std::uint64_t rank;
+  };
+
+  // In the wide index mode, the rank of a pack is relative to its group, and
+  // bases_[i] is the number of 1s in the preceding groups of packs.
+  static constexpr std::size_t PACKS_PER_GROUP = 1 << 16;
+
+  // A narrow index supports bit vectors of less than 2^38 bits because
+  // Rank::abs and select hints are 32-bit integers of units.
+  static constexpr std::uint64_t MAX_NARROW_SIZE = std::uint64_t(1) << 38;
+
+  // next_1/0() and prev_1/0() scan up to NUM_SCAN_UNITS units before using
+  // the directories.
+  static constexpr std::size_t NUM_SCAN_UNITS = 4;
+
+  static constexpr std::size_t LINE_SIZE = 448;
+  static constexpr std::size_t LINES_PER_GROUP = 32;
+
+  // The i-th bytes of LINE_SHIFTS/WIDTHS are for units[i] in a line.
+  static constexpr std::uint64_t LINE_SHIFTS = 0x372E251D150E00ULL;
+  static constexpr std::uint64_t LINE_WIDTHS = 0x09090908080700ULL;
+
   Vector<Pack> packs_;
+  Vector<Line> lines_;
+  Vector<std::uint64_t> bases_;
   std::size_t size_;
   std::size_t num_1s_;
   int flags_;
+  // A select hint is the index of the unit that has the (i * interval)-th
+  // 1/0, where interval is given by select_shift().
+  // In the wide index mode, each hint is stored as a pair of 32-bit integers.
   Vector<std::uint32_t> select_1s_;
   Vector<std::uint32_t> select_0s_;
+  // lazy_flags_ has ENABLE_SELECT_1/0 for the select indices that are not
+  // built yet, and lazy_mutex_ serializes their builds.
+  mutable std::atomic<int> lazy_flags_;
+  mutable std::mutex lazy_mutex_;
+
+  // line_rank() returns the number of 1s in the preceding units in the group.
+  static std::size_t line_rank(const Line &line, std::size_t j) noexcept {
+    const std::size_t shift = static_cast<std::size_t>(
+        (LINE_SHIFTS >> (j * 8)) & 0xFF);
+    const std::size_t width = static_cast<std::size_t>(
+        (LINE_WIDTHS >> (j * 8)) & 0xFF);
+    return static_cast<std::size_t>((line.rank & 0x3FFF)
+        + ((line.rank >> shift) & ((std::uint64_t(1) << width) - 1)));
+  }
+
+  std::size_t pack_base(std::size_t pack_id) const noexcept {
+    if (flags_ & MARISA2_WIDE_INDEX) {
+      return static_cast<std::size_t>(bases_[pack_id / PACKS_PER_GROUP]);
+    }
+    return 0;
+  }
+
+  std::size_t select_hint(const Vector<std::uint32_t> &hints,
+                          std::size_t i) const noexcept {
+    if (flags_ & MARISA2_WIDE_INDEX) {
+      return static_cast<std::size_t>(hints[i * 2]
+          | (static_cast<std::uint64_t>(hints[(i * 2) + 1]) << 32));
+    }
+    return hints[i];
+  }
+  void set_select_hint(Vector<std::uint32_t> &hints, std::size_t i,
+                       std::size_t unit_id) noexcept {
+    if (flags_ & MARISA2_WIDE_INDEX) {
+      hints[i * 2] = static_cast<std::uint32_t>(unit_id);
+      hints[(i * 2) + 1] = static_cast<std::uint32_t>(
+          static_cast<std::uint64_t>(unit_id) >> 32);
+    } else {
+      hints[i] = static_cast<std::uint32_t>(unit_id);
+    }
+  }
+  // select_shift() returns log2 of the select interval in flags, which must
+  // be valid.
+  static std::size_t select_shift(int flags) noexcept {
+    const int interval = (flags & MARISA2_SELECT_INTERVAL_MASK) >> 8;
+    return (interval == 0) ? 8 : static_cast<std::size_t>(interval + 5);
+  }
+  // num_select_hints() returns the size of hints for num_bits 1/0s.
+  static std::size_t num_select_hints(std::size_t num_bits,
+                                      int flags) noexcept {
+    const std::size_t shift = select_shift(flags);
+    const std::size_t num_hints = (num_bits >> shift)
+        + ((num_bits & ((std::size_t(1) << shift) - 1)) != 0) + 1;
+    return (flags & MARISA2_WIDE_INDEX) ? (num_hints * 2) : num_hints;
+  }
+
+  // select_hints() returns the select hints for Bit after building them if
+  // they are lazy. The hints are empty if they are not available.
+  template <bool Bit>
+  const Vector<std::uint32_t> &select_hints() const noexcept {
+    constexpr int flag =
+        Bit ? MARISA2_ENABLE_SELECT_1 : MARISA2_ENABLE_SELECT_0;
+    if (lazy_flags_.load(std::memory_order_acquire) & flag) {
+      build_lazy_select(flag);
+    }
+    return Bit ? select_1s_ : select_0s_;
+  }
+  void build_lazy_select(int flag) const noexcept;
+
+  template <bool Bit, typename F>
+  void for_each(std::size_t begin, std::size_t end, F &f) const {
+    if (begin >= end) {
+      return;
+    }
+    // The bits before begin are masked out of the first unit, and the bits
+    // after end are masked out of the last unit.
+    std::size_t unit_id = begin / 64;
+    const std::size_t last_unit_id = (end - 1) / 64;
+    std::uint64_t x = (Bit ? unit(unit_id) : ~unit(unit_id))
+        & (~std::uint64_t(0) << (begin % 64));
+    while (unit_id != last_unit_id) {
+      for ( ; x != 0; x &= x - 1) {
+        f((unit_id * 64) + SelectBit::lowest_bit(x));
+      }
+      ++unit_id;
+      x = Bit ? unit(unit_id) : ~unit(unit_id);
+    }
+    x &= ~std::uint64_t(0) >> (63 - ((end - 1) % 64));
+    for ( ; x != 0; x &= x - 1) {
+      f((unit_id * 64) + SelectBit::lowest_bit(x));
+    }
+  }
+
+  // num_blocks() returns the number of blocks except the sentinel.
+  std::size_t num_blocks() const noexcept {
+    return (flags_ & MARISA2_CACHE_LINE_LAYOUT) ?
+        (lines_.size() - 1) : (packs_.size() - 1);
+  }
+
+  // A block is a pack or a line, depending on the layout.
+  std::size_t num_units_per_block() const noexcept {
+    return (flags_ & MARISA2_CACHE_LINE_LAYOUT) ? 7 : 4;
+  }
+  std::size_t unit_id_to_block_id(std::size_t unit_id) const noexcept {
+    return (flags_ & MARISA2_CACHE_LINE_LAYOUT) ? (unit_id / 7) : (unit_id / 4);
+  }
+
+  std::uint64_t unit(std::size_t unit_id) const noexcept {
+    if (flags_ & MARISA2_CACHE_LINE_LAYOUT) {
+      return lines_[unit_id / 7].units[unit_id % 7];
+    }
+    return packs_[unit_id / 4].units[unit_id % 4];
+  }
+
+  // rank_block_1/0() return the number of 1/0s in the preceding blocks.
+  std::size_t rank_block_1(std::size_t block_id) const noexcept {
+    if (flags_ & MARISA2_CACHE_LINE_LAYOUT) {
+      return bases_[block_id / LINES_PER_GROUP]
+          + static_cast<std::size_t>(lines_[block_id].rank & 0x3FFF);
+    }
+    const Pack &pack = packs_[block_id];
+    return pack_base(block_id) + (static_cast<std::size_t>(pack.rank.abs) << 6)
+        + pack.rank.rels[0];
+  }
+  std::size_t rank_block_0(std::size_t block_id) const noexcept {
+    return (block_id * num_units_per_block() * 64) - rank_block_1(block_id);
+  }
+
+  // rank_unit_1/0() return the number of 1/0s in the preceding units.
+  std::size_t rank_unit_1(std::size_t unit_id) const noexcept {
+    if (flags_ & MARISA2_CACHE_LINE_LAYOUT) {
+      return bases_[unit_id / (7 * LINES_PER_GROUP)]
+          + line_rank(lines_[unit_id / 7], unit_id % 7);
+    }
+    const Pack &pack = packs_[unit_id / 4];
+    return pack_base(unit_id / 4)
+        + (static_cast<std::size_t>(pack.rank.abs) << 6)
+        + pack.rank.rels[unit_id % 4];
+  }
+  std::size_t rank_unit_0(std::size_t unit_id) const noexcept {
+    return (unit_id * 64) - rank_unit_1(unit_id);
+  }
+
+  // select_in_pack_1/0() and select_in_line_1/0() return the offset of the
+  // (i + 1)-th 1/0 in a block, where i does not include the 1/0s in the
+  // preceding blocks. For a line, i of select_in_line_1() includes the 1s in
+  // the preceding lines in the same group. The unit is found by counting
+  // the units whose ranks are not greater than i, which avoids unpredictable
+  // branches.
+  static std::size_t select_in_pack_1(const Pack &pack,
+                                      std::size_t i) noexcept {
+    const std::size_t j = (pack.rank.rels[1] <= i) + (pack.rank.rels[2] <= i)
+        + (pack.rank.rels[3] <= i);
+    return (j * 64)
+        + SelectBit::select_bit(pack.units[j], i - pack.rank.rels[j]);
+  }
+  static std::size_t select_in_pack_0(const Pack &pack,
+                                      std::size_t i) noexcept {
+    // The number of 0s in the preceding units in the pack is given by
+    // (64 * j) - (the number of 1s in the preceding units in the pack).
+    const std::size_t rank_0s[4] = {
+      0,
+      64 - static_cast<std::size_t>(pack.rank.rels[1] - pack.rank.rels[0]),
+      128 - static_cast<std::size_t>(pack.rank.rels[2] - pack.rank.rels[0]),
+      192 - static_cast<std::size_t>(pack.rank.rels[3] - pack.rank.rels[0])
+    };
+    const std::size_t j = (rank_0s[1] <= i) + (rank_0s[2] <= i)
+        + (rank_0s[3] <= i);
+    return (j * 64) + SelectBit::select_bit(~pack.units[j], i - rank_0s[j]);
+  }
+  static std::size_t select_in_line_1(const Line &line,
+                                      std::size_t i) noexcept {
+    std::size_t j = 0;
+    for (std::size_t k = 1; k < 7; ++k) {
+      j += line_rank(line, k) <= i;
+    }
+    return (j * 64)
+        + SelectBit::select_bit(line.units[j], i - line_rank(line, j));
+  }
+  static std::size_t select_in_line_0(const Line &line,
+                                      std::size_t i) noexcept {
+    const std::size_t offset = line_rank(line, 0);
+    std::size_t j = 0;
+    for (std::size_t k = 1; k < 7; ++k) {
+      j += ((k * 64) - (line_rank(line, k) - offset)) <= i;
+    }
+    return (j * 64) + SelectBit::select_bit(~line.units[j],
+        i - ((j * 64) - (line_rank(line, j) - offset)));
+  }
+
+  // select_in_block_1/0() return the position of the (i + 1)-th 1/0,
+  // which must be in the block.
+  std::size_t select_in_block_1(std::size_t block_id,
+                                std::size_t i) const noexcept;
+  std::size_t select_in_block_0(std::size_t block_id,
+                                std::size_t i) const noexcept;
+
+  template <bool Bit>
+  void select_batch(const std::size_t *ranks, std::size_t *out,
+                    std::size_t n) const noexcept;
+
+  // prefetch_rank() prefetches the memory to be accessed by rank_1(i), and
+  // prefetch_block() prefetches a block and its rank.
+  void prefetch_rank(std::size_t i) const noexcept;
+  void prefetch_block(std::size_t block_id) const noexcept;
+
+  // resize_packs() appends 0-filled packs so that num_bits bits can be stored.
+  Error resize_packs(std::size_t num_bits) noexcept;
+
+  // append() appends num_bits bits to a built bit vector. write_units() is
+  // called before size() is updated, and it ORs the new bits into the
+  // 0-filled units after size() by or_unit(). Memory is reserved in advance,
+  // so that the bit vector is unchanged on failure.
+  template <typename F>
+  Error append(std::size_t num_bits, F write_units) noexcept;
+  void or_unit(std::size_t unit_id, std::uint64_t bits) noexcept {
+    if (flags_ & MARISA2_CACHE_LINE_LAYOUT) {
+      lines_[unit_id / 7].units[unit_id % 7] |= bits;
+    } else {
+      packs_[unit_id / 4].units[unit_id % 4] |= bits;
+    }
+  }
+
+  // build_index() builds the indices as build() does. fill_units(begin, end)
+  // is called once for each pack in [begin, end) to fill the units before
+  // they are counted.
+  template <typename F>
+  Error build_index(int flags, std::size_t num_threads,
+                    F fill_units) noexcept;
+  template <typename F>
+  Error build_rank(bool wide, std::size_t num_threads, F fill_units) noexcept;
+  Error build_lines(std::size_t num_threads) noexcept;
+  Error build_select_1(std::size_t num_threads) noexcept;
+  Error build_select_0(std::size_t num_threads) noexcept;
 
-  Error build_rank() noexcept;
-  Error build_select_1() noexcept;
-  Error build_select_0() noexcept;
+  // fill_rank() and fill_lines() fill the ranks of the blocks in
+  // [begin, end), where count is the number of 1s in the preceding blocks.
+  // fill_rank() returns the number of 1s in the blocks up to end.
+  template <typename F>
+  std::size_t fill_rank(std::size_t begin, std::size_t end, std::size_t count,
+                        bool wide, F fill_units) noexcept;
+  void fill_lines(std::size_t begin, std::size_t end,
+                  std::size_t count) noexcept;
+  template <bool Bit>
+  void fill_select_hints(std::size_t begin, std::size_t end) noexcept;
+  // extend_select_hints() resizes the select hints for Bit and fills the
+  // hints for the 1/0s in the blocks from begin. The memory must be
+  // reserved.
+  template <bool Bit>
+  void extend_select_hints(std::size_t begin) noexcept;
 };
 
 }  // namespace grimoire
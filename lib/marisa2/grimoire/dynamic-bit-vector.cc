@@ -0,0 +1,608 @@
+#include <limits>
+
+#include "dynamic-bit-vector.h"
+
+namespace marisa2 {
+namespace grimoire {
+namespace {
+
+// read_bits() returns len bits starting at pos, where len must be in [1, 64].
+// Units after num_units are regarded as 0s.
+inline std::uint64_t read_bits(const std::uint64_t *units,
+                               std::size_t num_units, std::size_t pos,
+                               std::size_t len) noexcept {
+  const std::size_t unit_id = pos / 64;
+  const std::size_t offset = pos % 64;
+  std::uint64_t bits = units[unit_id] >> offset;
+  if (((offset + len) > 64) && ((unit_id + 1) < num_units)) {
+    bits |= units[unit_id + 1] << (64 - offset);
+  }
+  return (len == 64) ? bits : (bits & ((std::uint64_t(1) << len) - 1));
+}
+
+// copy_bits() copies len bits from src at src_pos to dst at dst_pos, where
+// the destination bits must be 0s.
+inline void copy_bits(std::uint64_t *dst, std::size_t dst_pos,
+                      const std::uint64_t *src, std::size_t num_src_units,
+                      std::size_t src_pos, std::size_t len) noexcept {
+  for (std::size_t i = 0; i < len; i += 64) {
+    const std::size_t num_bits = ((len - i) < 64) ? (len - i) : 64;
+    const std::uint64_t bits =
+        read_bits(src, num_src_units, src_pos + i, num_bits);
+    const std::size_t unit_id = (dst_pos + i) / 64;
+    const std::size_t offset = (dst_pos + i) % 64;
+    dst[unit_id] |= bits << offset;
+    if ((offset + num_bits) > 64) {
+      dst[unit_id + 1] |= bits >> (64 - offset);
+    }
+  }
+}
+
+// insert_bit() inserts bit at pos into units that have size bits, where size
+// must be less than the capacity.
+inline void insert_bit(std::uint64_t *units, std::size_t size,
+                       std::size_t pos, bool bit) noexcept {
+  const std::size_t unit_id = pos / 64;
+  const std::uint64_t mask = (std::uint64_t(1) << (pos % 64)) - 1;
+  std::uint64_t carry = units[unit_id] >> 63;
+  units[unit_id] = (units[unit_id] & mask) | ((units[unit_id] & ~mask) << 1)
+      | (std::uint64_t(bit) << (pos % 64));
+  for (std::size_t i = unit_id + 1; i <= (size / 64); ++i) {
+    const std::uint64_t next_carry = units[i] >> 63;
+    units[i] = (units[i] << 1) | carry;
+    carry = next_carry;
+  }
+}
+
+// erase_bit() removes the bit at pos from units that have size bits.
+inline void erase_bit(std::uint64_t *units, std::size_t size,
+                      std::size_t pos) noexcept {
+  const std::size_t unit_id = pos / 64;
+  const std::uint64_t mask = (std::uint64_t(1) << (pos % 64)) - 1;
+  units[unit_id] =
+      (units[unit_id] & mask) | ((units[unit_id] >> 1) & ~mask);
+  for (std::size_t i = unit_id + 1; (i * 64) < size; ++i) {
+    units[i - 1] |= units[i] << 63;
+    units[i] >>= 1;
+  }
+}
+
+inline std::size_t pop_count(const std::uint64_t *units,
+                             std::size_t num_units) noexcept {
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < num_units; ++i) {
+    count += PopCount::pop_count(units[i]);
+  }
+  return count;
+}
+
+}  // namespace
+
+DynamicBitVector::DynamicBitVector()
+  : nodes_(), leaves_(), free_node_(NO_ID), free_leaf_(NO_ID), root_(0),
+    height_(0), size_(0), num_1s_(0) {}
+
+DynamicBitVector::~DynamicBitVector() {}
+
+Error DynamicBitVector::insert(std::size_t i, bool bit) {
+  if (i > size_) {
+    return MARISA2_ERROR(MARISA2_BOUND_ERROR,
+                         "failed to insert bit: i > size()");
+  } else if (size_ == std::numeric_limits<std::size_t>::max()) {
+    return MARISA2_ERROR(MARISA2_SIZE_ERROR, "failed to insert bit: full");
+  }
+
+  if (height_ == 0) {
+    std::uint32_t root_id;
+    Error error = allocate_node(&root_id);
+    if (error) {
+      return error;
+    }
+    std::uint32_t leaf_id;
+    error = allocate_leaf(&leaf_id);
+    if (error) {
+      free_node(root_id);
+      return error;
+    }
+    insert_child(nodes_[root_id], 0, leaf_id, 0, 0);
+    root_ = root_id;
+    height_ = 1;
+  } else if (nodes_[root_].num_children == MAX_CHILDREN) {
+    // A full root becomes the only child of a new root, and then it is split.
+    if (height_ == MAX_HEIGHT) {
+      return MARISA2_ERROR(MARISA2_SIZE_ERROR, "failed to insert bit: full");
+    }
+    std::uint32_t root_id;
+    Error error = allocate_node(&root_id);
+    if (error) {
+      return error;
+    }
+    insert_child(nodes_[root_id], 0, root_, size_, num_1s_);
+    root_ = root_id;
+    ++height_;
+    error = split_child(root_, 0, height_ - 1);
+    if (error) {
+      return error;
+    }
+  }
+
+  // Full children are split on the way down, so that the leaf has room for
+  // the new bit. Counters are updated after the path is fixed.
+  Step path[MAX_HEIGHT];
+  std::uint32_t node_id = root_;
+  for (std::size_t k = 0; k < height_; ++k) {
+    const std::size_t level = height_ - k;
+    std::size_t j = 0;
+    while (((j + 1) < nodes_[node_id].num_children) &&
+           (i > nodes_[node_id].sizes[j])) {
+      i -= static_cast<std::size_t>(nodes_[node_id].sizes[j++]);
+    }
+    const Node &node = nodes_[node_id];
+    const bool is_full = (level == 1) ? (node.sizes[j] == LEAF_SIZE) :
+        (nodes_[node.children[j]].num_children == MAX_CHILDREN);
+    if (is_full) {
+      Error error = split_child(node_id, j, level - 1);
+      if (error) {
+        return error;
+      }
+      if (i > nodes_[node_id].sizes[j]) {
+        i -= static_cast<std::size_t>(nodes_[node_id].sizes[j++]);
+      }
+    }
+    path[k] = Step{ node_id, static_cast<std::uint32_t>(j) };
+    node_id = nodes_[node_id].children[j];
+  }
+
+  const Step &last = path[height_ - 1];
+  const std::size_t leaf_size =
+      static_cast<std::size_t>(nodes_[last.node_id].sizes[last.child_id]);
+  insert_bit(leaves_[node_id].units, leaf_size, i, bit);
+  for (std::size_t k = 0; k < height_; ++k) {
+    Node &node = nodes_[path[k].node_id];
+    ++node.sizes[path[k].child_id];
+    node.ones[path[k].child_id] += bit;
+  }
+  ++size_;
+  num_1s_ += bit;
+  return MARISA2_SUCCESS;
+}
+
+Error DynamicBitVector::erase(std::size_t i) {
+  if (i >= size_) {
+    return MARISA2_ERROR(MARISA2_BOUND_ERROR,
+                         "failed to erase bit: i >= size()");
+  }
+
+  // Minimal children are merged or rebalanced on the way down, so that no
+  // node underflows. These operations do not allocate memory.
+  Step path[MAX_HEIGHT];
+  std::uint32_t node_id = root_;
+  for (std::size_t k = 0; k < height_; ++k) {
+    const std::size_t level = height_ - k;
+    std::size_t j = 0;
+    while (i >= nodes_[node_id].sizes[j]) {
+      i -= static_cast<std::size_t>(nodes_[node_id].sizes[j++]);
+    }
+    const Node &node = nodes_[node_id];
+    if (node.num_children > 1) {
+      const bool is_minimal = (level == 1) ?
+          (node.sizes[j] <= (LEAF_SIZE / 2)) :
+          (nodes_[node.children[j]].num_children <= MIN_CHILDREN);
+      if (is_minimal) {
+        fix_child(node_id, level - 1, &j, &i);
+      }
+    }
+    path[k] = Step{ node_id, static_cast<std::uint32_t>(j) };
+    node_id = nodes_[node_id].children[j];
+  }
+
+  const Step &last = path[height_ - 1];
+  const std::size_t leaf_size =
+      static_cast<std::size_t>(nodes_[last.node_id].sizes[last.child_id]);
+  Leaf &leaf = leaves_[node_id];
+  const bool bit = ((leaf.units[i / 64] >> (i % 64)) & 1) != 0;
+  erase_bit(leaf.units, leaf_size, i);
+  for (std::size_t k = 0; k < height_; ++k) {
+    Node &node = nodes_[path[k].node_id];
+    --node.sizes[path[k].child_id];
+    node.ones[path[k].child_id] -= bit;
+  }
+  --size_;
+  num_1s_ -= bit;
+
+  // The root is replaced with its only child unless it is a leaf.
+  if ((height_ > 1) && (nodes_[root_].num_children == 1)) {
+    const std::uint32_t root_id = root_;
+    root_ = nodes_[root_id].children[0];
+    free_node(root_id);
+    --height_;
+  }
+  return MARISA2_SUCCESS;
+}
+
+Error DynamicBitVector::set(std::size_t i, bool bit) {
+  if (i >= size_) {
+    return MARISA2_ERROR(MARISA2_BOUND_ERROR, "failed to set bit: i >= size()");
+  }
+
+  Step path[MAX_HEIGHT];
+  const std::size_t offset = find_leaf(i, path);
+  const Step &last = path[height_ - 1];
+  Leaf &leaf = leaves_[nodes_[last.node_id].children[last.child_id]];
+  const std::uint64_t mask = std::uint64_t(1) << (offset % 64);
+  if (((leaf.units[offset / 64] & mask) != 0) == bit) {
+    return MARISA2_SUCCESS;
+  }
+  leaf.units[offset / 64] ^= mask;
+  for (std::size_t k = 0; k < height_; ++k) {
+    Node &node = nodes_[path[k].node_id];
+    if (bit) {
+      ++node.ones[path[k].child_id];
+    } else {
+      --node.ones[path[k].child_id];
+    }
+  }
+  if (bit) {
+    ++num_1s_;
+  } else {
+    --num_1s_;
+  }
+  return MARISA2_SUCCESS;
+}
+
+bool DynamicBitVector::operator[](std::size_t i) const {
+  Step path[MAX_HEIGHT];
+  const std::size_t offset = find_leaf(i, path);
+  const Step &last = path[height_ - 1];
+  const Leaf &leaf = leaves_[nodes_[last.node_id].children[last.child_id]];
+  return ((leaf.units[offset / 64] >> (offset % 64)) & 1) != 0;
+}
+
+std::size_t DynamicBitVector::rank_1(std::size_t i) const {
+  if (height_ == 0) {
+    return 0;
+  }
+  std::size_t rank = 0;
+  std::uint32_t node_id = root_;
+  for (std::size_t k = 0; k < height_; ++k) {
+    const Node &node = nodes_[node_id];
+    std::size_t j = 0;
+    while (((j + 1) < node.num_children) && (i >= node.sizes[j])) {
+      i -= static_cast<std::size_t>(node.sizes[j]);
+      rank += static_cast<std::size_t>(node.ones[j++]);
+    }
+    node_id = node.children[j];
+  }
+  const Leaf &leaf = leaves_[node_id];
+  rank += pop_count(leaf.units, i / 64);
+  if ((i % 64) != 0) {
+    rank += PopCount::pop_count(
+        leaf.units[i / 64] & ((std::uint64_t(1) << (i % 64)) - 1));
+  }
+  return rank;
+}
+
+std::size_t DynamicBitVector::select_1(std::size_t i) const {
+  std::size_t pos = 0;
+  std::uint32_t node_id = root_;
+  for (std::size_t k = 0; k < height_; ++k) {
+    const Node &node = nodes_[node_id];
+    std::size_t j = 0;
+    while (i >= node.ones[j]) {
+      i -= static_cast<std::size_t>(node.ones[j]);
+      pos += static_cast<std::size_t>(node.sizes[j++]);
+    }
+    node_id = node.children[j];
+  }
+  const Leaf &leaf = leaves_[node_id];
+  for (std::size_t j = 0; ; ++j) {
+    const std::size_t count = PopCount::pop_count(leaf.units[j]);
+    if (i < count) {
+      return pos + (j * 64) + SelectBit::select_bit(leaf.units[j], i);
+    }
+    i -= count;
+  }
+}
+
+std::size_t DynamicBitVector::select_0(std::size_t i) const {
+  // The 0s after the size of a leaf are never selected because the leaf has
+  // the (i + 1)-th 0 before them.
+  std::size_t pos = 0;
+  std::uint32_t node_id = root_;
+  for (std::size_t k = 0; k < height_; ++k) {
+    const Node &node = nodes_[node_id];
+    std::size_t j = 0;
+    while (i >= (node.sizes[j] - node.ones[j])) {
+      i -= static_cast<std::size_t>(node.sizes[j] - node.ones[j]);
+      pos += static_cast<std::size_t>(node.sizes[j++]);
+    }
+    node_id = node.children[j];
+  }
+  const Leaf &leaf = leaves_[node_id];
+  for (std::size_t j = 0; ; ++j) {
+    const std::size_t count = 64 - PopCount::pop_count(leaf.units[j]);
+    if (i < count) {
+      return pos + (j * 64) + SelectBit::select_bit(~leaf.units[j], i);
+    }
+    i -= count;
+  }
+}
+
+Error DynamicBitVector::freeze(BitVector &bit_vector, int flags,
+                               std::size_t num_threads) const {
+  BitVector new_bit_vector;
+  if (height_ != 0) {
+    Error error = append_leaves(new_bit_vector, root_, height_);
+    if (error) {
+      return error;
+    }
+  }
+  Error error = new_bit_vector.build(flags, num_threads);
+  if (error) {
+    return error;
+  }
+  bit_vector.swap(new_bit_vector);
+  return MARISA2_SUCCESS;
+}
+
+void DynamicBitVector::clear() {
+  DynamicBitVector().swap(*this);
+}
+
+void DynamicBitVector::swap(DynamicBitVector &rhs) {
+  nodes_.swap(rhs.nodes_);
+  leaves_.swap(rhs.leaves_);
+  std::swap(free_node_, rhs.free_node_);
+  std::swap(free_leaf_, rhs.free_leaf_);
+  std::swap(root_, rhs.root_);
+  std::swap(height_, rhs.height_);
+  std::swap(size_, rhs.size_);
+  std::swap(num_1s_, rhs.num_1s_);
+}
+
+Error DynamicBitVector::allocate_node(std::uint32_t *node_id) noexcept {
+  if (free_node_ != NO_ID) {
+    *node_id = free_node_;
+    free_node_ = nodes_[free_node_].children[0];
+  } else if (nodes_.size() >= NO_ID) {
+    return MARISA2_ERROR(MARISA2_SIZE_ERROR,
+                         "failed to allocate node: too many nodes");
+  } else {
+    Error error = nodes_.push_back(Node());
+    if (error) {
+      return error;
+    }
+    *node_id = static_cast<std::uint32_t>(nodes_.size() - 1);
+  }
+  nodes_[*node_id] = Node();
+  return MARISA2_SUCCESS;
+}
+
+Error DynamicBitVector::allocate_leaf(std::uint32_t *leaf_id) noexcept {
+  if (free_leaf_ != NO_ID) {
+    *leaf_id = free_leaf_;
+    free_leaf_ = static_cast<std::uint32_t>(leaves_[free_leaf_].units[0]);
+  } else if (leaves_.size() >= NO_ID) {
+    return MARISA2_ERROR(MARISA2_SIZE_ERROR,
+                         "failed to allocate leaf: too many leaves");
+  } else {
+    Error error = leaves_.push_back(Leaf());
+    if (error) {
+      return error;
+    }
+    *leaf_id = static_cast<std::uint32_t>(leaves_.size() - 1);
+  }
+  leaves_[*leaf_id] = Leaf();
+  return MARISA2_SUCCESS;
+}
+
+void DynamicBitVector::free_node(std::uint32_t node_id) noexcept {
+  nodes_[node_id].children[0] = free_node_;
+  free_node_ = node_id;
+}
+
+void DynamicBitVector::free_leaf(std::uint32_t leaf_id) noexcept {
+  leaves_[leaf_id].units[0] = free_leaf_;
+  free_leaf_ = leaf_id;
+}
+
+void DynamicBitVector::insert_child(Node &node, std::size_t j,
+                                    std::uint32_t child, std::uint64_t size,
+                                    std::uint64_t ones) noexcept {
+  for (std::size_t k = node.num_children; k > j; --k) {
+    node.sizes[k] = node.sizes[k - 1];
+    node.ones[k] = node.ones[k - 1];
+    node.children[k] = node.children[k - 1];
+  }
+  node.sizes[j] = size;
+  node.ones[j] = ones;
+  node.children[j] = child;
+  ++node.num_children;
+}
+
+void DynamicBitVector::remove_child(Node &node, std::size_t j) noexcept {
+  for (std::size_t k = j + 1; k < node.num_children; ++k) {
+    node.sizes[k - 1] = node.sizes[k];
+    node.ones[k - 1] = node.ones[k];
+    node.children[k - 1] = node.children[k];
+  }
+  --node.num_children;
+}
+
+Error DynamicBitVector::split_child(std::uint32_t node_id, std::size_t j,
+                                    std::size_t level) noexcept {
+  // The upper half of the child moves to a new sibling. References are taken
+  // after the allocation because it may move the elements.
+  std::uint32_t sibling_id;
+  std::uint64_t size = 0;
+  std::uint64_t ones = 0;
+  if (level == 0) {
+    Error error = allocate_leaf(&sibling_id);
+    if (error) {
+      return error;
+    }
+    Leaf &leaf = leaves_[nodes_[node_id].children[j]];
+    Leaf &sibling = leaves_[sibling_id];
+    for (std::size_t k = UNITS_PER_LEAF / 2; k < UNITS_PER_LEAF; ++k) {
+      sibling.units[k - (UNITS_PER_LEAF / 2)] = leaf.units[k];
+      leaf.units[k] = 0;
+    }
+    size = nodes_[node_id].sizes[j] - (LEAF_SIZE / 2);
+    ones = pop_count(sibling.units, UNITS_PER_LEAF / 2);
+  } else {
+    Error error = allocate_node(&sibling_id);
+    if (error) {
+      return error;
+    }
+    Node &child = nodes_[nodes_[node_id].children[j]];
+    Node &sibling = nodes_[sibling_id];
+    const std::size_t half = child.num_children / 2;
+    for (std::size_t k = half; k < child.num_children; ++k) {
+      insert_child(sibling, k - half, child.children[k], child.sizes[k],
+                   child.ones[k]);
+      size += child.sizes[k];
+      ones += child.ones[k];
+    }
+    child.num_children = static_cast<std::uint32_t>(half);
+  }
+
+  Node &node = nodes_[node_id];
+  node.sizes[j] -= size;
+  node.ones[j] -= ones;
+  insert_child(node, j + 1, sibling_id, size, ones);
+  return MARISA2_SUCCESS;
+}
+
+void DynamicBitVector::fix_child(std::uint32_t node_id, std::size_t level,
+                                 std::size_t *j, std::size_t *i) noexcept {
+  // The child is paired with its right sibling, or with its left sibling if
+  // it is the last child. pos is the position of the bit in the pair.
+  Node &node = nodes_[node_id];
+  const std::size_t left = ((*j + 1) < node.num_children) ? *j : (*j - 1);
+  const std::size_t right = left + 1;
+  const std::size_t pos = (*j == left) ? *i :
+      (static_cast<std::size_t>(node.sizes[left]) + *i);
+
+  if (level == 0) {
+    // The bits of the pair are concatenated and then split in half, unless
+    // they fit in one leaf.
+    Leaf &left_leaf = leaves_[node.children[left]];
+    Leaf &right_leaf = leaves_[node.children[right]];
+    const std::size_t left_size = static_cast<std::size_t>(node.sizes[left]);
+    const std::size_t size =
+        left_size + static_cast<std::size_t>(node.sizes[right]);
+    const std::uint64_t ones = node.ones[left] + node.ones[right];
+    if (size <= LEAF_SIZE) {
+      copy_bits(left_leaf.units, left_size, right_leaf.units, UNITS_PER_LEAF,
+                0, size - left_size);
+      free_leaf(node.children[right]);
+      remove_child(node, right);
+      node.sizes[left] = size;
+      node.ones[left] = ones;
+      *j = left;
+      *i = pos;
+      return;
+    }
+
+    std::uint64_t units[UNITS_PER_LEAF * 2] = {};
+    copy_bits(units, 0, left_leaf.units, UNITS_PER_LEAF, 0, left_size);
+    copy_bits(units, left_size, right_leaf.units, UNITS_PER_LEAF, 0,
+              size - left_size);
+    const std::size_t new_left_size = size / 2;
+    left_leaf = Leaf();
+    right_leaf = Leaf();
+    copy_bits(left_leaf.units, 0, units, UNITS_PER_LEAF * 2, 0,
+              new_left_size);
+    copy_bits(right_leaf.units, 0, units, UNITS_PER_LEAF * 2, new_left_size,
+              size - new_left_size);
+    node.sizes[left] = new_left_size;
+    node.ones[left] = pop_count(left_leaf.units, UNITS_PER_LEAF);
+    node.sizes[right] = size - new_left_size;
+    node.ones[right] = ones - node.ones[left];
+    *j = (pos < new_left_size) ? left : right;
+    *i = (pos < new_left_size) ? pos : (pos - new_left_size);
+    return;
+  }
+
+  Node &left_node = nodes_[node.children[left]];
+  Node &right_node = nodes_[node.children[right]];
+  if ((left_node.num_children + right_node.num_children) <= MAX_CHILDREN) {
+    // The children of the right node move to the left node.
+    for (std::size_t k = 0; k < right_node.num_children; ++k) {
+      insert_child(left_node, left_node.num_children, right_node.children[k],
+                   right_node.sizes[k], right_node.ones[k]);
+    }
+    node.sizes[left] += node.sizes[right];
+    node.ones[left] += node.ones[right];
+    free_node(node.children[right]);
+    remove_child(node, right);
+    *j = left;
+    *i = pos;
+  } else if (*j == left) {
+    // The first child of the right node moves to the end of the left node.
+    const std::uint64_t size = right_node.sizes[0];
+    const std::uint64_t ones = right_node.ones[0];
+    insert_child(left_node, left_node.num_children, right_node.children[0],
+                 size, ones);
+    remove_child(right_node, 0);
+    node.sizes[left] += size;
+    node.ones[left] += ones;
+    node.sizes[right] -= size;
+    node.ones[right] -= ones;
+  } else {
+    // The last child of the left node moves to the front of the right node.
+    const std::size_t last = left_node.num_children - 1;
+    const std::uint64_t size = left_node.sizes[last];
+    const std::uint64_t ones = left_node.ones[last];
+    insert_child(right_node, 0, left_node.children[last], size, ones);
+    remove_child(left_node, last);
+    node.sizes[left] -= size;
+    node.ones[left] -= ones;
+    node.sizes[right] += size;
+    node.ones[right] += ones;
+    *i += static_cast<std::size_t>(size);
+  }
+}
+
+std::size_t DynamicBitVector::find_leaf(std::size_t i,
+                                        Step *path) const noexcept {
+  std::uint32_t node_id = root_;
+  for (std::size_t k = 0; k < height_; ++k) {
+    const Node &node = nodes_[node_id];
+    std::size_t j = 0;
+    while (i >= node.sizes[j]) {
+      i -= static_cast<std::size_t>(node.sizes[j++]);
+    }
+    path[k] = Step{ node_id, static_cast<std::uint32_t>(j) };
+    node_id = node.children[j];
+  }
+  return i;
+}
+
+Error DynamicBitVector::append_leaves(BitVector &bit_vector,
+                                      std::uint32_t node_id,
+                                      std::size_t level) const noexcept {
+  const Node &node = nodes_[node_id];
+  for (std::size_t j = 0; j < node.num_children; ++j) {
+    if (level != 1) {
+      Error error = append_leaves(bit_vector, node.children[j], level - 1);
+      if (error) {
+        return error;
+      }
+      continue;
+    }
+    const Leaf &leaf = leaves_[node.children[j]];
+    const std::size_t size = static_cast<std::size_t>(node.sizes[j]);
+    for (std::size_t k = 0; k < size; k += 64) {
+      Error error = bit_vector.push_back_bits(leaf.units[k / 64],
+          ((size - k) < 64) ? (size - k) : 64);
+      if (error) {
+        return error;
+      }
+    }
+  }
+  return MARISA2_SUCCESS;
+}
+
+}  // namespace grimoire
+}  // namespace marisa2
@@ -0,0 +1,138 @@
+#ifndef MARISA2_GRIMOIRE_DYNAMIC_BIT_VECTOR_H
+#define MARISA2_GRIMOIRE_DYNAMIC_BIT_VECTOR_H
+
+#include "bit-vector.h"
+
+namespace marisa2 {
+namespace grimoire {
+
+// DynamicBitVector is a B-tree of 512-bit leaves, whose inner nodes have the
+// numbers of bits and 1s in their subtrees. insert(), erase(), set(),
+// rank_1/0(), and select_1/0() take O(log n) time. Leaves except the only
+// one have 256 to 512 bits, and inner nodes except the root have 8 to 16
+// children. freeze() turns it into a static BitVector.
+class MARISA2_DLL_EXPORT DynamicBitVector {
+ public:
+  DynamicBitVector() noexcept;
+  ~DynamicBitVector() noexcept;
+
+  DynamicBitVector(const DynamicBitVector &) = delete;
+  DynamicBitVector &operator=(const DynamicBitVector &) = delete;
+
+  explicit operator bool() const noexcept {
+    return size_ != 0;
+  }
+
+  // insert() inserts bit before the i-th bit, where i must be in
+  // [0, size()]. erase() removes the i-th bit, and set() overwrites it,
+  // where i must be in [0, size()).
+  Error insert(std::size_t i, bool bit) noexcept;
+  Error push_back(bool bit) noexcept {
+    return insert(size_, bit);
+  }
+  Error erase(std::size_t i) noexcept;
+  Error set(std::size_t i, bool bit) noexcept;
+
+  bool operator[](std::size_t i) const noexcept;
+
+  std::size_t rank_1(std::size_t i) const noexcept;
+  std::size_t rank_0(std::size_t i) const noexcept {
+    return i - rank_1(i);
+  }
+  std::size_t select_1(std::size_t i) const noexcept;
+  std::size_t select_0(std::size_t i) const noexcept;
+
+  std::size_t size() const noexcept {
+    return size_;
+  }
+  std::size_t num_1s() const noexcept {
+    return num_1s_;
+  }
+  std::size_t num_0s() const noexcept {
+    return size_ - num_1s_;
+  }
+  // height() returns the number of levels of inner nodes.
+  std::size_t height() const noexcept {
+    return height_;
+  }
+
+  // freeze() builds bit_vector from the bits with flags and num_threads as
+  // BitVector::build(). The leaves are appended unit by unit, and
+  // bit_vector is replaced only on success.
+  Error freeze(BitVector &bit_vector, int flags = 0,
+               std::size_t num_threads = 1) const noexcept;
+
+  void clear() noexcept;
+  void swap(DynamicBitVector &rhs) noexcept;
+
+ private:
+  static constexpr std::size_t LEAF_SIZE = 512;
+  static constexpr std::size_t UNITS_PER_LEAF = LEAF_SIZE / 64;
+  static constexpr std::size_t MAX_CHILDREN = 16;
+  static constexpr std::size_t MIN_CHILDREN = MAX_CHILDREN / 2;
+  static constexpr std::size_t MAX_HEIGHT = 32;
+  // NO_ID terminates the lists of free leaves and nodes.
+  static constexpr std::uint32_t NO_ID = 0xFFFFFFFFU;
+
+  // The bits after the size of a leaf are 0s. A free leaf has the next free
+  // leaf in units[0].
+  struct Leaf {
+    std::uint64_t units[UNITS_PER_LEAF];
+  };
+
+  // sizes[j] and ones[j] are the numbers of bits and 1s in the j-th subtree.
+  // The children of a node at level 1 are leaves. A free node has the next
+  // free node in children[0].
+  struct Node {
+    std::uint64_t sizes[MAX_CHILDREN];
+    std::uint64_t ones[MAX_CHILDREN];
+    std::uint32_t children[MAX_CHILDREN];
+    std::uint32_t num_children;
+  };
+
+  // A step of a path from the root is a node and the index of a child.
+  struct Step {
+    std::uint32_t node_id;
+    std::uint32_t child_id;
+  };
+
+  Vector<Node> nodes_;
+  Vector<Leaf> leaves_;
+  std::uint32_t free_node_;
+  std::uint32_t free_leaf_;
+  std::uint32_t root_;
+  std::size_t height_;
+  std::size_t size_;
+  std::size_t num_1s_;
+
+  Error allocate_node(std::uint32_t *node_id) noexcept;
+  Error allocate_leaf(std::uint32_t *leaf_id) noexcept;
+  void free_node(std::uint32_t node_id) noexcept;
+  void free_leaf(std::uint32_t leaf_id) noexcept;
+
+  // insert_child() and remove_child() shift the children of a node.
+  static void insert_child(Node &node, std::size_t j, std::uint32_t child,
+                           std::uint64_t size, std::uint64_t ones) noexcept;
+  static void remove_child(Node &node, std::size_t j) noexcept;
+
+  // split_child() splits the full j-th child of a node, and fix_child()
+  // merges or rebalances the minimal j-th child with its sibling. The child
+  // is at level, and fix_child() updates j and i so that they point to the
+  // same bit.
+  Error split_child(std::uint32_t node_id, std::size_t j,
+                    std::size_t level) noexcept;
+  void fix_child(std::uint32_t node_id, std::size_t level, std::size_t *j,
+                 std::size_t *i) noexcept;
+
+  // find_leaf() records the path to the leaf that has the i-th bit, and
+  // returns the offset of the bit in the leaf.
+  std::size_t find_leaf(std::size_t i, Step *path) const noexcept;
+
+  Error append_leaves(BitVector &bit_vector, std::uint32_t node_id,
+                      std::size_t level) const noexcept;
+};
+
+}  // namespace grimoire
+}  // namespace marisa2
+
+#endif  // MARISA2_GRIMOIRE_DYNAMIC_BIT_VECTOR_H
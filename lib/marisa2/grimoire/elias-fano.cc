@@ -0,0 +1,221 @@
+#include <limits>
+
+#include "elias-fano.h"
+
+namespace marisa2 {
+namespace grimoire {
+namespace {
+
+constexpr std::uint64_t SELECT_FLAGS =
+    MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0;
+
+}  // namespace
+
+EliasFano::EliasFano()
+  : high_(), lows_(), size_(0), num_low_bits_(0) {}
+
+EliasFano::~EliasFano() {}
+
+Error EliasFano::map(Mapper &mapper, const EliasFanoHeader &header) {
+  if (header.size > (std::numeric_limits<std::size_t>::max() / 64)) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to map Elias-Fano: too large");
+  } else if ((header.num_low_bits >= 64) ||
+             (header.high.num_1s != header.size) ||
+             (header.high.num_1s > header.high.size) ||
+             ((header.high.flags & SELECT_FLAGS) != SELECT_FLAGS) ||
+             (((header.high.size - header.high.num_1s) >>
+               (63 - header.num_low_bits)) > 1)) {
+    // access() and next_geq() use both select_1() and select_0(), and the
+    // higher bits, which are at most the number of 0s, must fit in
+    // (64 - num_low_bits) bits.
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to map Elias-Fano: invalid header");
+  }
+  const std::size_t new_size = static_cast<std::size_t>(header.size);
+  const std::size_t new_num_low_bits =
+      static_cast<std::size_t>(header.num_low_bits);
+
+  Vector<std::uint64_t> new_lows;
+  Error error = new_lows.map(mapper, VectorHeader{
+      num_low_units(new_size, new_num_low_bits) });
+  if (error) {
+    return error;
+  }
+  BitVector new_high;
+  error = new_high.map(mapper, header.high);
+  if (error) {
+    return error;
+  } else if ((new_high.size() != header.high.size) ||
+             (new_high.num_1s() != new_size)) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to map Elias-Fano: invalid high bits");
+  }
+
+  high_.swap(new_high);
+  lows_.swap(new_lows);
+  size_ = new_size;
+  num_low_bits_ = new_num_low_bits;
+  return MARISA2_SUCCESS;
+}
+
+Error EliasFano::read(Reader &reader, const EliasFanoHeader &header) {
+  if (header.size > (std::numeric_limits<std::size_t>::max() / 64)) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to read Elias-Fano: too large");
+  } else if ((header.num_low_bits >= 64) ||
+             (header.high.num_1s != header.size) ||
+             (header.high.num_1s > header.high.size) ||
+             ((header.high.flags & SELECT_FLAGS) != SELECT_FLAGS) ||
+             (((header.high.size - header.high.num_1s) >>
+               (63 - header.num_low_bits)) > 1)) {
+    // access() and next_geq() use both select_1() and select_0(), and the
+    // higher bits, which are at most the number of 0s, must fit in
+    // (64 - num_low_bits) bits.
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to read Elias-Fano: invalid header");
+  }
+  const std::size_t new_size = static_cast<std::size_t>(header.size);
+  const std::size_t new_num_low_bits =
+      static_cast<std::size_t>(header.num_low_bits);
+
+  Vector<std::uint64_t> new_lows;
+  Error error = new_lows.read(reader, VectorHeader{
+      num_low_units(new_size, new_num_low_bits) });
+  if (error) {
+    return error;
+  }
+  BitVector new_high;
+  error = new_high.read(reader, header.high);
+  if (error) {
+    return error;
+  } else if ((new_high.size() != header.high.size) ||
+             (new_high.num_1s() != new_size)) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to read Elias-Fano: invalid high bits");
+  }
+
+  high_.swap(new_high);
+  lows_.swap(new_lows);
+  size_ = new_size;
+  num_low_bits_ = new_num_low_bits;
+  return MARISA2_SUCCESS;
+}
+
+Error EliasFano::write(Writer &writer) {
+  if (high_.flags() == 0) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to write Elias-Fano: not built");
+  }
+
+  Error error = lows_.write(writer);
+  if (error) {
+    return error;
+  }
+  return high_.write(writer);
+}
+
+Error EliasFano::build(const std::uint64_t *values, std::size_t num_values) {
+  if (high_.flags() != 0) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to build Elias-Fano: already built");
+  } else if ((values == nullptr) && (num_values != 0)) {
+    return MARISA2_ERROR(MARISA2_NULL_ERROR,
+                         "failed to build Elias-Fano: values == nullptr");
+  } else if (num_values > (std::numeric_limits<std::size_t>::max() / 64)) {
+    return MARISA2_ERROR(MARISA2_SIZE_ERROR,
+                         "failed to build Elias-Fano: too many values");
+  }
+  for (std::size_t i = 1; i < num_values; ++i) {
+    if (values[i] < values[i - 1]) {
+      return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                           "failed to build Elias-Fano: unsorted values");
+    }
+  }
+
+  // num_low_bits is floor(log2(max / n)), so that high_ has at most about
+  // 2n bits.
+  std::size_t new_num_low_bits = 0;
+  if (num_values != 0) {
+    const std::uint64_t ratio = values[num_values - 1] / num_values;
+    while ((ratio >> new_num_low_bits) > 1) {
+      ++new_num_low_bits;
+    }
+  }
+
+  Vector<std::uint64_t> new_lows;
+  Error error = new_lows.resize(num_low_units(num_values, new_num_low_bits),
+                                0);
+  if (error) {
+    return error;
+  }
+  if (new_num_low_bits != 0) {
+    const std::uint64_t mask = (std::uint64_t(1) << new_num_low_bits) - 1;
+    for (std::size_t i = 0; i < num_values; ++i) {
+      const std::size_t pos = i * new_num_low_bits;
+      const std::size_t shift = pos % 64;
+      new_lows[pos / 64] |= (values[i] & mask) << shift;
+      if ((shift + new_num_low_bits) > 64) {
+        new_lows[(pos / 64) + 1] |= (values[i] & mask) >> (64 - shift);
+      }
+    }
+  }
+
+  // The gaps of the higher bits are stored in unary.
+  BitVector new_high;
+  std::uint64_t prev_high = 0;
+  for (std::size_t i = 0; i < num_values; ++i) {
+    const std::uint64_t high = values[i] >> new_num_low_bits;
+    for (std::uint64_t gap = high - prev_high; gap != 0; ) {
+      const std::size_t num_0s =
+          (gap < 64) ? static_cast<std::size_t>(gap) : 64;
+      error = new_high.push_back_bits(0, num_0s);
+      if (error) {
+        return error;
+      }
+      gap -= num_0s;
+    }
+    error = new_high.push_back(true);
+    if (error) {
+      return error;
+    }
+    prev_high = high;
+  }
+  error = new_high.build(MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0);
+  if (error) {
+    return error;
+  }
+  error = new_lows.shrink();
+  if (error) {
+    return error;
+  }
+
+  high_.swap(new_high);
+  lows_.swap(new_lows);
+  size_ = num_values;
+  num_low_bits_ = new_num_low_bits;
+  return MARISA2_SUCCESS;
+}
+
+std::size_t EliasFano::next_geq(std::uint64_t x) const {
+  // The values whose higher bits are less than those of x are skipped by
+  // select_0(), and then the candidates are scanned by next_1().
+  const std::uint64_t x_high = x >> num_low_bits_;
+  if (x_high > high_.num_0s()) {
+    return size_;
+  }
+  const std::uint64_t x_low = x & ((std::uint64_t(1) << num_low_bits_) - 1);
+  std::size_t pos = (x_high == 0) ? 0 :
+      (high_.select_0(static_cast<std::size_t>(x_high) - 1) + 1);
+  for (std::size_t i = pos - static_cast<std::size_t>(x_high); i < size_;
+       ++i, ++pos) {
+    pos = high_.next_1(pos);
+    if (((pos - i) > x_high) || (low(i) >= x_low)) {
+      return i;
+    }
+  }
+  return size_;
+}
+
+}  // namespace grimoire
+}  // namespace marisa2
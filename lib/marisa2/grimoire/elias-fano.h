@@ -0,0 +1,101 @@
+#ifndef MARISA2_GRIMOIRE_ELIAS_FANO_H
+#define MARISA2_GRIMOIRE_ELIAS_FANO_H
+
+#include "bit-vector.h"
+
+namespace marisa2 {
+namespace grimoire {
+
+struct EliasFanoHeader {
+  std::uint64_t size;
+  std::uint64_t num_low_bits;
+  BitVectorHeader high;
+};
+
+// EliasFano stores a non-decreasing sequence of 64-bit integers in about
+// (2 + log2(u / n)) bits per value, where n is the number of values and u is
+// the maximum value. The lower num_low_bits bits of each value are packed
+// into lows_, and the rest are stored in unary as gaps in high_, where the
+// i-th 1 is at ((values[i] >> num_low_bits) + i).
+class MARISA2_DLL_EXPORT EliasFano {
+ public:
+  EliasFano() noexcept;
+  ~EliasFano() noexcept;
+
+  EliasFano(const EliasFano &) = delete;
+  EliasFano &operator=(const EliasFano &) = delete;
+
+  explicit operator bool() const noexcept {
+    return size_ != 0;
+  }
+
+  Error map(Mapper &mapper, const EliasFanoHeader &header) noexcept;
+  Error read(Reader &reader, const EliasFanoHeader &header) noexcept;
+  Error write(Writer &writer) noexcept;
+
+  // build() encodes num_values values, which must be sorted in
+  // non-decreasing order.
+  Error build(const std::uint64_t *values, std::size_t num_values) noexcept;
+
+  // access() returns the (i + 1)-th value.
+  std::uint64_t access(std::size_t i) const noexcept {
+    return (static_cast<std::uint64_t>(high_.select_1(i) - i)
+            << num_low_bits_) | low(i);
+  }
+  std::uint64_t operator[](std::size_t i) const noexcept {
+    return access(i);
+  }
+
+  // next_geq() returns the index of the first value that is not less than x,
+  // or size() if there is no such value.
+  std::size_t next_geq(std::uint64_t x) const noexcept;
+
+  // rank() returns the number of values less than x, and select() returns
+  // the (i + 1)-th value. They regard values as positions of 1s.
+  std::size_t rank(std::uint64_t x) const noexcept {
+    return next_geq(x);
+  }
+  std::uint64_t select(std::size_t i) const noexcept {
+    return access(i);
+  }
+
+  std::size_t size() const noexcept {
+    return size_;
+  }
+  std::size_t num_low_bits() const noexcept {
+    return num_low_bits_;
+  }
+  EliasFanoHeader header() const noexcept {
+    return EliasFanoHeader{ size_, num_low_bits_, high_.header() };
+  }
+
+ private:
+  BitVector high_;
+  Vector<std::uint64_t> lows_;
+  std::size_t size_;
+  std::size_t num_low_bits_;
+
+  std::uint64_t low(std::size_t i) const noexcept {
+    if (num_low_bits_ == 0) {
+      return 0;
+    }
+    const std::size_t pos = i * num_low_bits_;
+    const std::size_t unit_id = pos / 64;
+    const std::size_t shift = pos % 64;
+    std::uint64_t bits = lows_[unit_id] >> shift;
+    if ((shift + num_low_bits_) > 64) {
+      bits |= lows_[unit_id + 1] << (64 - shift);
+    }
+    return bits & ((std::uint64_t(1) << num_low_bits_) - 1);
+  }
+
+  static std::size_t num_low_units(std::size_t size,
+                                   std::size_t num_low_bits) noexcept {
+    return ((size * num_low_bits) / 64) + (((size * num_low_bits) % 64) != 0);
+  }
+};
+
+}  // namespace grimoire
+}  // namespace marisa2
+
+#endif  // MARISA2_GRIMOIRE_ELIAS_FANO_H
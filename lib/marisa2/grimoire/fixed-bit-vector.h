@@ -0,0 +1,362 @@
+#ifndef MARISA2_GRIMOIRE_FIXED_BIT_VECTOR_H
+#define MARISA2_GRIMOIRE_FIXED_BIT_VECTOR_H
+
+#include <type_traits>
+#include <utility>
+
+#include "bit-vector.h"
+
+namespace marisa2 {
+namespace grimoire {
+
+// FixedVector<T, Enabled, Tag> is a Vector<T> that is omitted if Enabled is
+// false. Tag distinguishes the bases of FixedBitVector, so that the empty
+// ones take no space.
+template <typename T, bool Enabled, int Tag>
+class FixedVector {
+ public:
+  Vector<T> &vector() noexcept {
+    return vector_;
+  }
+  const Vector<T> &vector() const noexcept {
+    return vector_;
+  }
+
+  void swap(FixedVector &rhs) noexcept {
+    vector_.swap(rhs.vector_);
+  }
+  void swap_vector(Vector<T> &rhs) noexcept {
+    vector_.swap(rhs);
+  }
+  Error write_vector(Writer &writer) const noexcept {
+    return vector_.write(writer);
+  }
+
+ private:
+  Vector<T> vector_;
+};
+
+template <typename T, int Tag>
+class FixedVector<T, false, Tag> {
+ public:
+  void swap(FixedVector &) noexcept {}
+  void swap_vector(Vector<T> &) noexcept {}
+  Error write_vector(Writer &) const noexcept {
+    return MARISA2_SUCCESS;
+  }
+};
+
+// FixedBitVector<Flags> is a BitVector whose flags are fixed at compile time.
+// Flags is a combination of MARISA2_ENABLE_SELECT_1/0,
+// MARISA2_CACHE_LINE_LAYOUT, MARISA2_WIDE_INDEX, and one of
+// MARISA2_SELECT_INTERVAL_*. The members for the other layout and for
+// disabled indices are omitted, and queries have no branches on flags, so
+// that they are fully inlined. Images are compatible with BitVector.
+template <int Flags>
+class FixedBitVector
+    : private FixedVector<std::uint64_t, (Flags & (MARISA2_CACHE_LINE_LAYOUT
+                                                   | MARISA2_WIDE_INDEX)) != 0,
+                          0>,
+      private FixedVector<std::uint32_t,
+                          (Flags & MARISA2_ENABLE_SELECT_1) != 0, 1>,
+      private FixedVector<std::uint32_t,
+                          (Flags & MARISA2_ENABLE_SELECT_0) != 0, 2> {
+  static_assert((Flags & ~(MARISA2_ENABLE_RANK | MARISA2_ENABLE_SELECT_1 |
+      MARISA2_ENABLE_SELECT_0 | MARISA2_CACHE_LINE_LAYOUT |
+      MARISA2_WIDE_INDEX | MARISA2_SELECT_INTERVAL_MASK)) == 0,
+      "Flags has an unknown flag.");
+  static_assert((Flags & MARISA2_SELECT_INTERVAL_MASK) <=
+      MARISA2_SELECT_INTERVAL_8192, "Flags has an unknown interval.");
+
+ public:
+  FixedBitVector() noexcept : blocks_(), size_(0), num_1s_(0) {}
+  ~FixedBitVector() noexcept {}
+
+  FixedBitVector(const FixedBitVector &) = delete;
+  FixedBitVector &operator=(const FixedBitVector &) = delete;
+
+  explicit operator bool() const noexcept {
+    return size_ != 0;
+  }
+
+  // build() takes the directories of bit_vector, which must be built with
+  // the same layout, index width, and select interval. Missing select
+  // indices are built, and unused ones are dropped. bit_vector is cleared on
+  // success.
+  Error build(BitVector &bit_vector) noexcept {
+    if (bit_vector.flags() == 0) {
+      return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                           "failed to build fixed bit vector: not built");
+    } else if ((bit_vector.flags() & LAYOUT_FLAGS) != (Flags & LAYOUT_FLAGS)) {
+      return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                           "failed to build fixed bit vector: wrong layout");
+    } else if (BitVector::select_shift(bit_vector.flags()) != SELECT_SHIFT) {
+      return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                           "failed to build fixed bit vector: wrong interval");
+    }
+    Error error = bit_vector.enable_select(Flags);
+    if (error) {
+      return error;
+    }
+
+    FixedBitVector new_bit_vector;
+    new_bit_vector.blocks_.swap(blocks_of(bit_vector, IsLine()));
+    new_bit_vector.Bases::swap_vector(bit_vector.bases_);
+    new_bit_vector.Select1s::swap_vector(bit_vector.select_1s_);
+    new_bit_vector.Select0s::swap_vector(bit_vector.select_0s_);
+    new_bit_vector.size_ = bit_vector.size_;
+    new_bit_vector.num_1s_ = bit_vector.num_1s_;
+    swap(new_bit_vector);
+
+    BitVector().swap(bit_vector);
+    return MARISA2_SUCCESS;
+  }
+
+  // map() and read() accept images written by BitVector::write() with the
+  // same layout, index width, select indices, and select interval.
+  Error map(Mapper &mapper, const BitVectorHeader &header) noexcept {
+    if ((header.flags & (LAYOUT_FLAGS | SELECT_FLAGS)) !=
+        static_cast<std::uint64_t>(Flags & (LAYOUT_FLAGS | SELECT_FLAGS)) ||
+        (BitVector::select_shift(static_cast<int>(header.flags))
+            != SELECT_SHIFT)) {
+      return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                           "failed to map fixed bit vector: wrong flags");
+    }
+    BitVector bit_vector;
+    Error error = bit_vector.map(mapper, header);
+    if (error) {
+      return error;
+    }
+    return build(bit_vector);
+  }
+  Error read(Reader &reader, const BitVectorHeader &header) noexcept {
+    if ((header.flags & (LAYOUT_FLAGS | SELECT_FLAGS)) !=
+        static_cast<std::uint64_t>(Flags & (LAYOUT_FLAGS | SELECT_FLAGS)) ||
+        (BitVector::select_shift(static_cast<int>(header.flags))
+            != SELECT_SHIFT)) {
+      return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                           "failed to read fixed bit vector: wrong flags");
+    }
+    BitVector bit_vector;
+    Error error = bit_vector.read(reader, header);
+    if (error) {
+      return error;
+    }
+    return build(bit_vector);
+  }
+  Error write(Writer &writer) const noexcept {
+    if (blocks_.size() == 0) {
+      return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                           "failed to write fixed bit vector: not built");
+    }
+
+    Error error = blocks_.write(writer);
+    if (error) {
+      return error;
+    }
+    error = Bases::write_vector(writer);
+    if (error) {
+      return error;
+    }
+    error = Select1s::write_vector(writer);
+    if (error) {
+      return error;
+    }
+    return Select0s::write_vector(writer);
+  }
+
+  void swap(FixedBitVector &rhs) noexcept {
+    blocks_.swap(rhs.blocks_);
+    Bases::swap(rhs);
+    Select1s::swap(rhs);
+    Select0s::swap(rhs);
+    std::swap(size_, rhs.size_);
+    std::swap(num_1s_, rhs.num_1s_);
+  }
+
+  bool operator[](std::size_t i) const noexcept {
+    return (unit(i / 64, IsLine()) >> (i % 64)) & 1;
+  }
+
+  std::size_t rank_1(std::size_t i) const noexcept {
+    return rank_1(i, IsLine());
+  }
+  std::size_t rank_0(std::size_t i) const noexcept {
+    return i - rank_1(i);
+  }
+
+  std::size_t select_1(std::size_t i) const noexcept {
+    static_assert((Flags & MARISA2_ENABLE_SELECT_1) != 0,
+                  "MARISA2_ENABLE_SELECT_1 is not given.");
+    return select_in_block_1(find_block<true>(Select1s::vector(), i), i,
+                             IsLine());
+  }
+  std::size_t select_0(std::size_t i) const noexcept {
+    static_assert((Flags & MARISA2_ENABLE_SELECT_0) != 0,
+                  "MARISA2_ENABLE_SELECT_0 is not given.");
+    return select_in_block_0(find_block<false>(Select0s::vector(), i), i,
+                             IsLine());
+  }
+
+  std::size_t size() const noexcept {
+    return size_;
+  }
+  std::size_t num_1s() const noexcept {
+    return num_1s_;
+  }
+  std::size_t num_0s() const noexcept {
+    return size_ - num_1s_;
+  }
+  BitVectorHeader header() const noexcept {
+    return BitVectorHeader{ size_, num_1s_,
+        static_cast<std::uint64_t>(Flags | MARISA2_ENABLE_RANK) };
+  }
+
+ private:
+  static constexpr int LAYOUT_FLAGS =
+      MARISA2_CACHE_LINE_LAYOUT | MARISA2_WIDE_INDEX;
+  static constexpr int SELECT_FLAGS =
+      MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0;
+  // SELECT_SHIFT is the same as BitVector::select_shift(Flags).
+  static constexpr std::size_t SELECT_SHIFT =
+      ((Flags & MARISA2_SELECT_INTERVAL_MASK) == 0) ? 8 :
+      static_cast<std::size_t>(((Flags & MARISA2_SELECT_INTERVAL_MASK) >> 8)
+                               + 5);
+
+  // Functions for each layout and index width are chosen by these tags.
+  typedef std::integral_constant<bool,
+      (Flags & MARISA2_CACHE_LINE_LAYOUT) != 0> IsLine;
+  typedef std::integral_constant<bool,
+      (Flags & MARISA2_WIDE_INDEX) != 0> IsWide;
+
+  typedef typename std::conditional<IsLine::value, BitVector::Line,
+                                    BitVector::Pack>::type Block;
+  typedef FixedVector<std::uint64_t, IsLine::value || IsWide::value, 0> Bases;
+  typedef FixedVector<std::uint32_t,
+                      (Flags & MARISA2_ENABLE_SELECT_1) != 0, 1> Select1s;
+  typedef FixedVector<std::uint32_t,
+                      (Flags & MARISA2_ENABLE_SELECT_0) != 0, 2> Select0s;
+
+  Vector<Block> blocks_;
+  std::size_t size_;
+  std::size_t num_1s_;
+
+  static Vector<BitVector::Line> &blocks_of(BitVector &bit_vector,
+                                            std::true_type) noexcept {
+    return bit_vector.lines_;
+  }
+  static Vector<BitVector::Pack> &blocks_of(BitVector &bit_vector,
+                                            std::false_type) noexcept {
+    return bit_vector.packs_;
+  }
+
+  std::uint64_t unit(std::size_t unit_id, std::true_type) const noexcept {
+    return blocks_[unit_id / 7].units[unit_id % 7];
+  }
+  std::uint64_t unit(std::size_t unit_id, std::false_type) const noexcept {
+    return blocks_[unit_id / 4].units[unit_id % 4];
+  }
+
+  std::size_t pack_base(std::size_t pack_id, std::true_type) const noexcept {
+    return static_cast<std::size_t>(
+        Bases::vector()[pack_id / BitVector::PACKS_PER_GROUP]);
+  }
+  std::size_t pack_base(std::size_t, std::false_type) const noexcept {
+    return 0;
+  }
+
+  std::size_t rank_1(std::size_t i, std::true_type) const noexcept {
+    const Block &line = blocks_[i / BitVector::LINE_SIZE];
+    const std::size_t j = (i / 64) % 7;
+    return static_cast<std::size_t>(Bases::vector()[
+        i / (BitVector::LINE_SIZE * BitVector::LINES_PER_GROUP)])
+        + BitVector::line_rank(line, j)
+        + PopCount::pop_count((line.units[j] << 1) << (63 - (i % 64)));
+  }
+  std::size_t rank_1(std::size_t i, std::false_type) const noexcept {
+    const Block &pack = blocks_[i / 256];
+    const std::size_t j = (i / 64) % 4;
+    return pack_base(i / 256, IsWide())
+        + (static_cast<std::size_t>(pack.rank.abs) << 6) + pack.rank.rels[j]
+        + PopCount::pop_count((pack.units[j] << 1) << (63 - (i % 64)));
+  }
+
+  std::size_t rank_block_1(std::size_t block_id,
+                           std::true_type) const noexcept {
+    return static_cast<std::size_t>(
+        Bases::vector()[block_id / BitVector::LINES_PER_GROUP]
+        + (blocks_[block_id].rank & 0x3FFF));
+  }
+  std::size_t rank_block_1(std::size_t block_id,
+                           std::false_type) const noexcept {
+    const Block &pack = blocks_[block_id];
+    return pack_base(block_id, IsWide())
+        + (static_cast<std::size_t>(pack.rank.abs) << 6) + pack.rank.rels[0];
+  }
+  std::size_t rank_block_0(std::size_t block_id) const noexcept {
+    return (block_id * (IsLine::value ? BitVector::LINE_SIZE : 256))
+        - rank_block_1(block_id, IsLine());
+  }
+
+  std::size_t select_in_block_1(std::size_t block_id, std::size_t i,
+                                std::true_type) const noexcept {
+    return (block_id * BitVector::LINE_SIZE)
+        + BitVector::select_in_line_1(blocks_[block_id],
+            i - static_cast<std::size_t>(
+                Bases::vector()[block_id / BitVector::LINES_PER_GROUP]));
+  }
+  std::size_t select_in_block_1(std::size_t block_id, std::size_t i,
+                                std::false_type) const noexcept {
+    const Block &pack = blocks_[block_id];
+    return (block_id * 256) + BitVector::select_in_pack_1(pack,
+        i - pack_base(block_id, IsWide())
+        - (static_cast<std::size_t>(pack.rank.abs) << 6));
+  }
+  std::size_t select_in_block_0(std::size_t block_id, std::size_t i,
+                                std::true_type) const noexcept {
+    return (block_id * BitVector::LINE_SIZE) + BitVector::select_in_line_0(
+        blocks_[block_id], i - rank_block_0(block_id));
+  }
+  std::size_t select_in_block_0(std::size_t block_id, std::size_t i,
+                                std::false_type) const noexcept {
+    return (block_id * 256) + BitVector::select_in_pack_0(
+        blocks_[block_id], i - rank_block_0(block_id));
+  }
+
+  // find_block() returns the block that has the (i + 1)-th 1/0 in the same
+  // way as BitVector::select_1/0().
+  template <bool Bit>
+  std::size_t find_block(const Vector<std::uint32_t> &hints,
+                         std::size_t i) const noexcept {
+    std::size_t begin = hint_block(hints, i >> SELECT_SHIFT);
+    std::size_t end = hint_block(hints, (i >> SELECT_SHIFT) + 1);
+    while ((begin + 8) < end) {
+      const std::size_t middle = (begin + end + 1) / 2;
+      if ((Bit ? rank_block_1(middle, IsLine())
+               : rank_block_0(middle)) <= i) {
+        begin = middle;
+      } else {
+        end = middle - 1;
+      }
+    }
+    while ((begin < end) && ((Bit ? rank_block_1(begin + 1, IsLine())
+                                  : rank_block_0(begin + 1)) <= i)) {
+      ++begin;
+    }
+    return begin;
+  }
+  // hint_block() returns the block that has the unit of the i-th hint.
+  static std::size_t hint_block(const Vector<std::uint32_t> &hints,
+                                std::size_t i) noexcept {
+    const std::size_t unit_id = IsWide::value ?
+        static_cast<std::size_t>(hints[i * 2]
+            | (static_cast<std::uint64_t>(hints[(i * 2) + 1]) << 32)) :
+        static_cast<std::size_t>(hints[i]);
+    return IsLine::value ? (unit_id / 7) : (unit_id / 4);
+  }
+};
+
+}  // namespace grimoire
+}  // namespace marisa2
+
+#endif  // MARISA2_GRIMOIRE_FIXED_BIT_VECTOR_H
@@ -0,0 +1,509 @@
+#include <limits>
+
+#include "hybrid-bit-vector.h"
+#include "pop-count.h"
+#include "select-bit.h"
+
+namespace marisa2 {
+namespace grimoire {
+namespace {
+
+// find_bit() returns the position of the first Bit at or after pos in
+// num_units units, or (num_units * 64) if there is no such bit.
+template <bool Bit>
+std::size_t find_bit(const std::uint64_t *units, std::size_t num_units,
+                     std::size_t pos) noexcept {
+  std::size_t unit_id = pos / 64;
+  if (unit_id >= num_units) {
+    return num_units * 64;
+  }
+  std::uint64_t unit = (Bit ? units[unit_id] : ~units[unit_id])
+      & (~std::uint64_t(0) << (pos % 64));
+  while (unit == 0) {
+    if (++unit_id == num_units) {
+      return num_units * 64;
+    }
+    unit = Bit ? units[unit_id] : ~units[unit_id];
+  }
+  return (unit_id * 64) + SelectBit::lowest_bit(unit);
+}
+
+}  // namespace
+
+HybridBitVector::HybridBitVector()
+  : blocks_(), words_(), size_(0), num_1s_(0), fixed_(false), units_() {}
+
+HybridBitVector::~HybridBitVector() {}
+
+Error HybridBitVector::map(Mapper &mapper,
+                           const HybridBitVectorHeader &header) {
+  if ((header.size > std::numeric_limits<std::size_t>::max()) ||
+      (header.num_words > std::numeric_limits<std::size_t>::max())) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to map hybrid bit vector: too large");
+  } else if (header.num_1s > header.size) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to map hybrid bit vector: invalid header");
+  }
+  const std::size_t num_blocks =
+      static_cast<std::size_t>((header.size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+
+  Vector<Block> new_blocks;
+  Error error = new_blocks.map(mapper, VectorHeader{ num_blocks + 1 });
+  if (error) {
+    return error;
+  }
+  Vector<std::uint64_t> new_words;
+  error = new_words.map(mapper, VectorHeader{ header.num_words });
+  if (error) {
+    return error;
+  }
+  if ((new_blocks[num_blocks].rank != header.num_1s) ||
+      (new_blocks[num_blocks].offset != header.num_words)) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to map hybrid bit vector: invalid blocks");
+  }
+
+  blocks_.swap(new_blocks);
+  words_.swap(new_words);
+  size_ = static_cast<std::size_t>(header.size);
+  num_1s_ = static_cast<std::size_t>(header.num_1s);
+  fixed_ = true;
+  units_.clear();
+  return MARISA2_SUCCESS;
+}
+
+Error HybridBitVector::read(Reader &reader,
+                            const HybridBitVectorHeader &header) {
+  if ((header.size > std::numeric_limits<std::size_t>::max()) ||
+      (header.num_words > std::numeric_limits<std::size_t>::max())) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to read hybrid bit vector: too large");
+  } else if (header.num_1s > header.size) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to read hybrid bit vector: invalid header");
+  }
+  const std::size_t num_blocks =
+      static_cast<std::size_t>((header.size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+
+  Vector<Block> new_blocks;
+  Error error = new_blocks.read(reader, VectorHeader{ num_blocks + 1 });
+  if (error) {
+    return error;
+  }
+  if ((new_blocks[num_blocks].rank != header.num_1s) ||
+      (new_blocks[num_blocks].offset != header.num_words)) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to read hybrid bit vector: invalid blocks");
+  }
+  Vector<std::uint64_t> new_words;
+  error = new_words.read(reader, VectorHeader{ header.num_words });
+  if (error) {
+    return error;
+  }
+
+  blocks_.swap(new_blocks);
+  words_.swap(new_words);
+  size_ = static_cast<std::size_t>(header.size);
+  num_1s_ = static_cast<std::size_t>(header.num_1s);
+  fixed_ = true;
+  units_.clear();
+  return MARISA2_SUCCESS;
+}
+
+Error HybridBitVector::write(Writer &writer) {
+  if (!fixed_) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to write hybrid bit vector: not fixed");
+  }
+
+  Error error = blocks_.write(writer);
+  if (error) {
+    return error;
+  }
+  return words_.write(writer);
+}
+
+Error HybridBitVector::push_back_bits(std::uint64_t bits,
+                                      std::size_t num_bits) {
+  if (fixed_) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to push bits: already fixed");
+  } else if (num_bits > 64) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to push bits: num_bits > 64");
+  } else if (num_bits > (std::numeric_limits<std::size_t>::max() - size_)) {
+    return MARISA2_ERROR(MARISA2_SIZE_ERROR, "failed to push bits: full");
+  } else if (num_bits == 0) {
+    return MARISA2_SUCCESS;
+  }
+
+  // units_ has an extra unit for bits that overflow the current block.
+  if (units_.size() == 0) {
+    Error error = units_.resize(UNITS_PER_BLOCK + 1, 0);
+    if (error) {
+      return error;
+    }
+  }
+
+  if (num_bits != 64) {
+    bits &= (std::uint64_t(1) << num_bits) - 1;
+  }
+  const std::size_t pos = size_ % BLOCK_SIZE;
+  const std::size_t unit_id = pos / 64;
+  const std::size_t shift = pos % 64;
+  units_[unit_id] |= bits << shift;
+  if ((shift + num_bits) > 64) {
+    units_[unit_id + 1] = bits >> (64 - shift);
+  }
+  size_ += num_bits;
+  num_1s_ += PopCount::pop_count(bits);
+
+  if ((size_ % BLOCK_SIZE) < num_bits) {
+    Error error = push_block();
+    if (error) {
+      return error;
+    }
+    units_[0] = units_[UNITS_PER_BLOCK];
+    for (std::size_t i = 1; i <= UNITS_PER_BLOCK; ++i) {
+      units_[i] = 0;
+    }
+  }
+  return MARISA2_SUCCESS;
+}
+
+Error HybridBitVector::build() {
+  if (fixed_) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to build hybrid bit vector: already fixed");
+  }
+
+  if ((size_ % BLOCK_SIZE) != 0) {
+    Error error = push_block();
+    if (error) {
+      return error;
+    }
+  }
+  Error error = blocks_.push_back(
+      Block{ num_1s_, words_.size(), PLAIN_BLOCK, 0 });
+  if (error) {
+    return error;
+  }
+  error = blocks_.shrink();
+  if (error) {
+    return error;
+  }
+  error = words_.shrink();
+  if (error) {
+    return error;
+  }
+  units_.clear();
+  fixed_ = true;
+  return MARISA2_SUCCESS;
+}
+
+std::size_t HybridBitVector::rank_1(std::size_t i) const {
+  const std::size_t block_id = i / BLOCK_SIZE;
+  const std::size_t offset = i % BLOCK_SIZE;
+  const std::size_t rank = static_cast<std::size_t>(blocks_[block_id].rank);
+  return (offset == 0) ? rank : (rank + rank_in_block(block_id, offset));
+}
+
+std::size_t HybridBitVector::select_1(std::size_t i) const {
+  // Find the last block whose rank is not greater than i.
+  std::size_t begin = 0;
+  std::size_t end = blocks_.size() - 1;
+  while (begin < end) {
+    const std::size_t middle = (begin + end) / 2;
+    if (blocks_[middle].rank <= i) {
+      begin = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+  const std::size_t block_id = begin - 1;
+  return (block_id * BLOCK_SIZE) + select_in_block_1(
+      block_id, i - static_cast<std::size_t>(blocks_[block_id].rank));
+}
+
+std::size_t HybridBitVector::select_0(std::size_t i) const {
+  std::size_t begin = 0;
+  std::size_t end = blocks_.size() - 1;
+  while (begin < end) {
+    const std::size_t middle = (begin + end) / 2;
+    if (block_0s(middle) <= i) {
+      begin = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+  const std::size_t block_id = begin - 1;
+  return (block_id * BLOCK_SIZE)
+      + select_in_block_0(block_id, i - block_0s(block_id));
+}
+
+std::size_t HybridBitVector::num_blocks(std::size_t type) const {
+  std::size_t count = 0;
+  for (std::size_t i = 0; (i + 1) < blocks_.size(); ++i) {
+    count += blocks_[i].type == type;
+  }
+  return count;
+}
+
+std::size_t HybridBitVector::rank_in_block(std::size_t block_id,
+                                           std::size_t offset) const {
+  const Block &block = blocks_[block_id];
+  switch (block.type) {
+    case PLAIN_BLOCK: {
+      const std::size_t subblock_id = offset / SUBBLOCK_SIZE;
+      const std::uint64_t *units =
+          &words_[block.offset + PLAIN_RANK_WORDS];
+      std::size_t rank = value(block, subblock_id);
+      for (std::size_t j = subblock_id * (SUBBLOCK_SIZE / 64);
+           j < (offset / 64); ++j) {
+        rank += PopCount::pop_count(units[j]);
+      }
+      if ((offset % 64) != 0) {
+        rank += PopCount::pop_count(units[offset / 64]
+            & ((std::uint64_t(1) << (offset % 64)) - 1));
+      }
+      return rank;
+    }
+    case SPARSE_BLOCK: {
+      // Count the positions less than offset.
+      std::size_t begin = 0;
+      std::size_t end = block.count;
+      while (begin < end) {
+        const std::size_t middle = (begin + end) / 2;
+        if (value(block, middle) < offset) {
+          begin = middle + 1;
+        } else {
+          end = middle;
+        }
+      }
+      return begin;
+    }
+    default: {
+      // Find the last run that starts before offset.
+      std::size_t begin = 0;
+      std::size_t end = block.count / 2;
+      while (begin < end) {
+        const std::size_t middle = (begin + end) / 2;
+        if (value(block, middle * 2) < offset) {
+          begin = middle + 1;
+        } else {
+          end = middle;
+        }
+      }
+      if (begin == 0) {
+        return 0;
+      }
+      const std::size_t run_id = begin - 1;
+      const std::size_t start = value(block, run_id * 2);
+      const std::size_t rank = value(block, (run_id * 2) + 1);
+      const std::size_t next_rank = ((begin * 2) < block.count) ?
+          value(block, (begin * 2) + 1) :
+          static_cast<std::size_t>(blocks_[block_id + 1].rank - block.rank);
+      const std::size_t length = next_rank - rank;
+      return rank + (((offset - start) < length) ? (offset - start) : length);
+    }
+  }
+}
+
+std::size_t HybridBitVector::select_in_block_1(std::size_t block_id,
+                                               std::size_t i) const {
+  const Block &block = blocks_[block_id];
+  switch (block.type) {
+    case PLAIN_BLOCK: {
+      std::size_t begin = 0;
+      std::size_t end = SUBBLOCKS_PER_BLOCK;
+      while (begin < end) {
+        const std::size_t middle = (begin + end) / 2;
+        if (value(block, middle) <= i) {
+          begin = middle + 1;
+        } else {
+          end = middle;
+        }
+      }
+      const std::uint64_t *units =
+          &words_[block.offset + PLAIN_RANK_WORDS];
+      std::size_t unit_id = (begin - 1) * (SUBBLOCK_SIZE / 64);
+      i -= value(block, begin - 1);
+      for (std::size_t count = PopCount::pop_count(units[unit_id]);
+           count <= i; count = PopCount::pop_count(units[++unit_id])) {
+        i -= count;
+      }
+      return (unit_id * 64) + SelectBit::select_bit(units[unit_id], i);
+    }
+    case SPARSE_BLOCK: {
+      return value(block, i);
+    }
+    default: {
+      std::size_t begin = 0;
+      std::size_t end = block.count / 2;
+      while (begin < end) {
+        const std::size_t middle = (begin + end) / 2;
+        if (value(block, (middle * 2) + 1) <= i) {
+          begin = middle + 1;
+        } else {
+          end = middle;
+        }
+      }
+      const std::size_t run_id = begin - 1;
+      return value(block, run_id * 2) + (i - value(block, (run_id * 2) + 1));
+    }
+  }
+}
+
+std::size_t HybridBitVector::select_in_block_0(std::size_t block_id,
+                                               std::size_t i) const {
+  const Block &block = blocks_[block_id];
+  switch (block.type) {
+    case PLAIN_BLOCK: {
+      std::size_t begin = 0;
+      std::size_t end = SUBBLOCKS_PER_BLOCK;
+      while (begin < end) {
+        const std::size_t middle = (begin + end) / 2;
+        if (((middle * SUBBLOCK_SIZE) - value(block, middle)) <= i) {
+          begin = middle + 1;
+        } else {
+          end = middle;
+        }
+      }
+      const std::uint64_t *units =
+          &words_[block.offset + PLAIN_RANK_WORDS];
+      std::size_t unit_id = (begin - 1) * (SUBBLOCK_SIZE / 64);
+      i -= ((begin - 1) * SUBBLOCK_SIZE) - value(block, begin - 1);
+      for (std::size_t count = PopCount::pop_count(~units[unit_id]);
+           count <= i; count = PopCount::pop_count(~units[++unit_id])) {
+        i -= count;
+      }
+      return (unit_id * 64) + SelectBit::select_bit(~units[unit_id], i);
+    }
+    case SPARSE_BLOCK: {
+      // (position - j) is the number of 0s before the (j + 1)-th 1, and
+      // each 1 that has i or fewer 0s before it precedes the answer.
+      std::size_t begin = 0;
+      std::size_t end = block.count;
+      while (begin < end) {
+        const std::size_t middle = (begin + end) / 2;
+        if ((value(block, middle) - middle) <= i) {
+          begin = middle + 1;
+        } else {
+          end = middle;
+        }
+      }
+      return i + begin;
+    }
+    default: {
+      // (start - rank) is the number of 0s before a run.
+      std::size_t begin = 0;
+      std::size_t end = block.count / 2;
+      while (begin < end) {
+        const std::size_t middle = (begin + end) / 2;
+        if ((value(block, middle * 2) - value(block, (middle * 2) + 1))
+            <= i) {
+          begin = middle + 1;
+        } else {
+          end = middle;
+        }
+      }
+      if (begin == 0) {
+        return i;
+      }
+      const std::size_t run_id = begin - 1;
+      const std::size_t start = value(block, run_id * 2);
+      const std::size_t rank = value(block, (run_id * 2) + 1);
+      const std::size_t next_rank = ((begin * 2) < block.count) ?
+          value(block, (begin * 2) + 1) :
+          static_cast<std::size_t>(blocks_[block_id + 1].rank - block.rank);
+      return start + (next_rank - rank) + (i - (start - rank));
+    }
+  }
+}
+
+Error HybridBitVector::push_block() {
+  // The number of 1s and the number of runs of 1s decide the encoding.
+  std::size_t count = 0;
+  std::size_t num_runs = 0;
+  std::uint64_t carry = 0;
+  for (std::size_t i = 0; i < UNITS_PER_BLOCK; ++i) {
+    count += PopCount::pop_count(units_[i]);
+    num_runs += PopCount::pop_count(units_[i] & ~((units_[i] << 1) | carry));
+    carry = units_[i] >> 63;
+  }
+  const std::size_t sparse_words = (count + 3) / 4;
+  const std::size_t run_words = ((num_runs * 2) + 3) / 4;
+
+  Block block;
+  // num_1s_ includes the bits that overflow into the next block.
+  block.rank = num_1s_ - count - PopCount::pop_count(units_[UNITS_PER_BLOCK]);
+  block.offset = words_.size();
+  if ((sparse_words <= run_words) && (sparse_words < PLAIN_WORDS)) {
+    block.type = SPARSE_BLOCK;
+    block.count = static_cast<std::uint32_t>(count);
+    for (std::size_t i = 0, j = 0; i < UNITS_PER_BLOCK; ++i) {
+      for (std::uint64_t unit = units_[i]; unit != 0; unit &= unit - 1) {
+        Error error = push_value(j++, (i * 64) + SelectBit::lowest_bit(unit));
+        if (error) {
+          return error;
+        }
+      }
+    }
+  } else if (run_words < PLAIN_WORDS) {
+    block.type = RUN_BLOCK;
+    block.count = static_cast<std::uint32_t>(num_runs * 2);
+    std::size_t rank = 0;
+    std::size_t j = 0;
+    for (std::size_t start = find_bit<true>(&units_[0], UNITS_PER_BLOCK, 0);
+         start < BLOCK_SIZE; ) {
+      const std::size_t end =
+          find_bit<false>(&units_[0], UNITS_PER_BLOCK, start);
+      Error error = push_value(j++, start);
+      if (error) {
+        return error;
+      }
+      error = push_value(j++, rank);
+      if (error) {
+        return error;
+      }
+      rank += end - start;
+      start = find_bit<true>(&units_[0], UNITS_PER_BLOCK, end);
+    }
+  } else {
+    block.type = PLAIN_BLOCK;
+    block.count = 0;
+    std::size_t rank = 0;
+    for (std::size_t i = 0; i < SUBBLOCKS_PER_BLOCK; ++i) {
+      Error error = push_value(i, rank);
+      if (error) {
+        return error;
+      }
+      for (std::size_t j = 0; j < (SUBBLOCK_SIZE / 64); ++j) {
+        rank += PopCount::pop_count(units_[(i * (SUBBLOCK_SIZE / 64)) + j]);
+      }
+    }
+    for (std::size_t i = 0; i < UNITS_PER_BLOCK; ++i) {
+      Error error = words_.push_back(units_[i]);
+      if (error) {
+        return error;
+      }
+    }
+  }
+  return blocks_.push_back(block);
+}
+
+Error HybridBitVector::push_value(std::size_t i, std::size_t value) {
+  if ((i % 4) == 0) {
+    Error error = words_.push_back(0);
+    if (error) {
+      return error;
+    }
+  }
+  words_[words_.size() - 1] |=
+      static_cast<std::uint64_t>(value) << ((i % 4) * 16);
+  return MARISA2_SUCCESS;
+}
+
+}  // namespace grimoire
+}  // namespace marisa2
@@ -0,0 +1,142 @@
+#ifndef MARISA2_GRIMOIRE_HYBRID_BIT_VECTOR_H
+#define MARISA2_GRIMOIRE_HYBRID_BIT_VECTOR_H
+
+#include "vector.h"
+
+namespace marisa2 {
+namespace grimoire {
+
+struct HybridBitVectorHeader {
+  std::uint64_t size;
+  std::uint64_t num_1s;
+  std::uint64_t num_words;
+};
+
+// HybridBitVector splits bits into blocks of 2^16 bits and encodes each block
+// in the smallest of the following encodings:
+// - PLAIN_BLOCK stores the bits and the ranks of 512-bit subblocks,
+// - SPARSE_BLOCK stores the 16-bit positions of 1s, and
+// - RUN_BLOCK stores the 16-bit starts and ranks of runs of 1s.
+// A directory of blocks gives rank_1/0() and select_1/0() for all the
+// encodings, so that a bit vector whose density varies is kept small.
+class MARISA2_DLL_EXPORT HybridBitVector {
+ public:
+  HybridBitVector() noexcept;
+  ~HybridBitVector() noexcept;
+
+  HybridBitVector(const HybridBitVector &) = delete;
+  HybridBitVector &operator=(const HybridBitVector &) = delete;
+
+  explicit operator bool() const noexcept {
+    return size_ != 0;
+  }
+
+  Error map(Mapper &mapper, const HybridBitVectorHeader &header) noexcept;
+  Error read(Reader &reader, const HybridBitVectorHeader &header) noexcept;
+  Error write(Writer &writer) noexcept;
+
+  Error push_back(bool bit) noexcept {
+    return push_back_bits(bit, 1);
+  }
+  // push_back_bits() appends the lower num_bits bits of bits, where num_bits
+  // must be in [0, 64].
+  Error push_back_bits(std::uint64_t bits, std::size_t num_bits) noexcept;
+
+  // build() encodes the last block and makes the bit vector ready for
+  // queries. Bits cannot be appended after build().
+  Error build() noexcept;
+
+  bool operator[](std::size_t i) const noexcept {
+    return (rank_1(i + 1) - rank_1(i)) != 0;
+  }
+
+  // rank_1/0() and select_1/0() are available after build().
+  std::size_t rank_1(std::size_t i) const noexcept;
+  std::size_t rank_0(std::size_t i) const noexcept {
+    return i - rank_1(i);
+  }
+  std::size_t select_1(std::size_t i) const noexcept;
+  std::size_t select_0(std::size_t i) const noexcept;
+
+  std::size_t size() const noexcept {
+    return size_;
+  }
+  std::size_t num_1s() const noexcept {
+    return num_1s_;
+  }
+  std::size_t num_0s() const noexcept {
+    return size_ - num_1s_;
+  }
+  // num_blocks() returns the number of blocks encoded in type, which is one
+  // of PLAIN_BLOCK, SPARSE_BLOCK, and RUN_BLOCK.
+  std::size_t num_blocks(std::size_t type) const noexcept;
+  std::size_t total_size() const noexcept {
+    return (blocks_.size() * sizeof(Block))
+        + (words_.size() * sizeof(std::uint64_t));
+  }
+  HybridBitVectorHeader header() const noexcept {
+    return HybridBitVectorHeader{ size_, num_1s_, words_.size() };
+  }
+
+  enum {
+    PLAIN_BLOCK  = 0,
+    SPARSE_BLOCK = 1,
+    RUN_BLOCK    = 2
+  };
+
+ private:
+  // rank is the number of 1s in the preceding blocks, and offset is the
+  // index of the first word of the block in words_. count is the number of
+  // 16-bit values for SPARSE_BLOCK and RUN_BLOCK. The last block is a
+  // sentinel.
+  struct Block {
+    std::uint64_t rank;
+    std::uint64_t offset;
+    std::uint32_t type;
+    std::uint32_t count;
+  };
+
+  static constexpr std::size_t BLOCK_SIZE = std::size_t(1) << 16;
+  static constexpr std::size_t UNITS_PER_BLOCK = BLOCK_SIZE / 64;
+  static constexpr std::size_t SUBBLOCK_SIZE = 512;
+  static constexpr std::size_t SUBBLOCKS_PER_BLOCK = BLOCK_SIZE / 512;
+  // A plain block has the ranks of subblocks in 16 bits, followed by units.
+  static constexpr std::size_t PLAIN_RANK_WORDS = SUBBLOCKS_PER_BLOCK / 4;
+  static constexpr std::size_t PLAIN_WORDS =
+      PLAIN_RANK_WORDS + UNITS_PER_BLOCK;
+
+  Vector<Block> blocks_;
+  Vector<std::uint64_t> words_;
+  std::size_t size_;
+  std::size_t num_1s_;
+  bool fixed_;
+  // units_ has the bits of the last block until it is filled.
+  Vector<std::uint64_t> units_;
+
+  // value() returns the i-th 16-bit value of a block.
+  std::size_t value(const Block &block, std::size_t i) const noexcept {
+    return static_cast<std::size_t>(
+        (words_[block.offset + (i / 4)] >> ((i % 4) * 16)) & 0xFFFF);
+  }
+  std::size_t block_0s(std::size_t block_id) const noexcept {
+    return (block_id * BLOCK_SIZE)
+        - static_cast<std::size_t>(blocks_[block_id].rank);
+  }
+
+  // rank_in_block() returns the number of 1s before offset in a block, and
+  // select_in_block_1/0() return the offset of the (i + 1)-th 1/0.
+  std::size_t rank_in_block(std::size_t block_id,
+                            std::size_t offset) const noexcept;
+  std::size_t select_in_block_1(std::size_t block_id,
+                                std::size_t i) const noexcept;
+  std::size_t select_in_block_0(std::size_t block_id,
+                                std::size_t i) const noexcept;
+
+  Error push_block() noexcept;
+  Error push_value(std::size_t i, std::size_t value) noexcept;
+};
+
+}  // namespace grimoire
+}  // namespace marisa2
+
+#endif  // MARISA2_GRIMOIRE_HYBRID_BIT_VECTOR_H
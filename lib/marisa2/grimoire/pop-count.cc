@@ -0,0 +1,30 @@
+#include "pop-count.h"
+
+#ifdef MARISA2_HAS_POPCNT_DISPATCH
+# include <cpuid.h>
+#endif  // MARISA2_HAS_POPCNT_DISPATCH
+
+namespace marisa2 {
+namespace grimoire {
+namespace {
+
+#ifdef MARISA2_HAS_POPCNT_DISPATCH
+bool detect_popcnt() noexcept {
+  unsigned int eax, ebx, ecx, edx;
+  if (::__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+    return false;
+  }
+  return (ecx & bit_POPCNT) != 0;
+}
+#endif  // MARISA2_HAS_POPCNT_DISPATCH
+
+}  // namespace
+
+#ifdef MARISA2_HAS_POPCNT_DISPATCH
+const bool PopCount::uses_popcnt_ = detect_popcnt();
+#else  // MARISA2_HAS_POPCNT_DISPATCH
+const bool PopCount::uses_popcnt_ = false;
+#endif  // MARISA2_HAS_POPCNT_DISPATCH
+
+}  // namespace grimoire
+}  // namespace marisa2
@@ -3,10 +3,16 @@
 
 #include <cstdint>
 
+#include "../features.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+# define MARISA2_HAS_POPCNT_DISPATCH
+#endif  // defined(__x86_64__) && defined(__GNUC__)
+
 namespace marisa2 {
 namespace grimoire {
 
-class PopCount {
+class MARISA2_DLL_EXPORT PopCount {
  public:
   PopCount() = default;
   explicit constexpr PopCount(std::uint64_t x) noexcept
@@ -21,21 +27,59 @@ class PopCount {
   constexpr std::uint8_t operator[](std::size_t i) noexcept {
     return static_cast<std::uint8_t>(value_ >> (i << 3));
   }
+  // value() returns all the counts, where the i-th byte is pop_count[i].
+  constexpr std::uint64_t value() noexcept {
+    return value_;
+  }
 
-  // ::__builtin_popcountll() uses popcnt if -msse4.2 is specified.
+  // pop_count() uses popcnt if the running CPU supports it, so that one
+  // binary works well on both old and new CPUs. The check is skipped if
+  // popcnt is enabled at compile time by -msse4.2 or MARISA2_USE_POPCNT.
+  // The branch is predictable and cheaper than a call to a function with
+  // __attribute__((target("popcnt"))), which cannot be inlined.
   // Note: ::__builtin_popcountll() is not constexpr on Mac OSX.
 //  static constexpr std::uint8_t pop_count(std::uint64_t x) noexcept {
   static std::uint8_t pop_count(std::uint64_t x) noexcept {
-#ifdef MARISA2_USE_POPCNT
+#if defined(MARISA2_USE_POPCNT) || defined(__POPCNT__)
     return static_cast<std::uint8_t>(::__builtin_popcountll(x));
-#else  // MARISA2_USE_POPCNT
+#elif defined(MARISA2_HAS_POPCNT_DISPATCH)
+    return uses_popcnt_ ? pop_count_popcnt(x) : pop_count_broadword(x);
+#else  // defined(MARISA2_USE_POPCNT) || defined(__POPCNT__)
+    return pop_count_broadword(x);
+#endif  // defined(MARISA2_USE_POPCNT) || defined(__POPCNT__)
+  }
+
+  // uses_popcnt() returns whether pop_count() uses popcnt.
+  static bool uses_popcnt() noexcept {
+#if defined(MARISA2_USE_POPCNT) || defined(__POPCNT__)
+    return true;
+#else  // defined(MARISA2_USE_POPCNT) || defined(__POPCNT__)
+    return uses_popcnt_;
+#endif  // defined(MARISA2_USE_POPCNT) || defined(__POPCNT__)
+  }
+
+  // The following functions are the implementations of pop_count().
+  // pop_count_popcnt() must not be called if uses_popcnt() returns false.
+  // It is written in inline assembly because the assembler accepts popcnt
+  // without -msse4.2.
+  static std::uint8_t pop_count_popcnt(std::uint64_t x) noexcept {
+#ifdef MARISA2_HAS_POPCNT_DISPATCH
+    std::uint64_t count;
+    __asm__("popcntq %1, %0" : "=r"(count) : "rm"(x));
+    return static_cast<std::uint8_t>(count);
+#else  // MARISA2_HAS_POPCNT_DISPATCH
+    return pop_count_broadword(x);
+#endif  // MARISA2_HAS_POPCNT_DISPATCH
+  }
+  static std::uint8_t pop_count_broadword(std::uint64_t x) noexcept {
     return static_cast<std::uint8_t>(pop_count_1st(x) >> 56);
-#endif  // MARISA2_USE_POPCNT
   }
 
  private:
   std::uint64_t value_;
 
+  static const bool uses_popcnt_;
+
   // See http://en.wikipedia.org/wiki/Hamming_weight for details.
   static constexpr std::uint64_t MASK_55 = 0x5555555555555555ULL;
   static constexpr std::uint64_t MASK_33 = 0x3333333333333333ULL;
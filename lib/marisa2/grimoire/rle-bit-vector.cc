@@ -0,0 +1,226 @@
+#include <limits>
+
+#include "rle-bit-vector.h"
+#include "select-bit.h"
+
+namespace marisa2 {
+namespace grimoire {
+
+RleBitVector::RleBitVector()
+  : runs_(), size_(0), num_1s_(0), num_runs_(0), fixed_(false) {}
+
+RleBitVector::~RleBitVector() {}
+
+Error RleBitVector::map(Mapper &mapper, const RleBitVectorHeader &header) {
+  if (header.size > std::numeric_limits<std::size_t>::max()) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to map RLE bit vector: too large");
+  } else if ((header.num_1s > header.size) ||
+             (header.num_runs > header.num_1s) ||
+             (header.num_runs > ((header.size / 2) + (header.size % 2)))) {
+    // Runs of 1s are separated by 0s, so there are at most ceil(size / 2)
+    // runs, and num_runs + 1 does not overflow.
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to map RLE bit vector: invalid header");
+  }
+
+  Vector<Run> new_runs;
+  Error error = new_runs.map(mapper, VectorHeader{ header.num_runs + 1 });
+  if (error) {
+    return error;
+  }
+  if ((new_runs.back().start != header.size) ||
+      (new_runs.back().rank != header.num_1s)) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to map RLE bit vector: invalid runs");
+  }
+
+  runs_.swap(new_runs);
+  size_ = static_cast<std::size_t>(header.size);
+  num_1s_ = static_cast<std::size_t>(header.num_1s);
+  num_runs_ = static_cast<std::size_t>(header.num_runs);
+  fixed_ = true;
+  return MARISA2_SUCCESS;
+}
+
+Error RleBitVector::read(Reader &reader, const RleBitVectorHeader &header) {
+  if (header.size > std::numeric_limits<std::size_t>::max()) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to read RLE bit vector: too large");
+  } else if ((header.num_1s > header.size) ||
+             (header.num_runs > header.num_1s) ||
+             (header.num_runs > ((header.size / 2) + (header.size % 2)))) {
+    // Runs of 1s are separated by 0s, so there are at most ceil(size / 2)
+    // runs, and num_runs + 1 does not overflow.
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to read RLE bit vector: invalid header");
+  }
+
+  Vector<Run> new_runs;
+  Error error = new_runs.read(reader, VectorHeader{ header.num_runs + 1 });
+  if (error) {
+    return error;
+  }
+  if ((new_runs.back().start != header.size) ||
+      (new_runs.back().rank != header.num_1s)) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to read RLE bit vector: invalid runs");
+  }
+
+  runs_.swap(new_runs);
+  size_ = static_cast<std::size_t>(header.size);
+  num_1s_ = static_cast<std::size_t>(header.num_1s);
+  num_runs_ = static_cast<std::size_t>(header.num_runs);
+  fixed_ = true;
+  return MARISA2_SUCCESS;
+}
+
+Error RleBitVector::write(Writer &writer) {
+  if (!fixed_) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to write RLE bit vector: not fixed");
+  }
+  return runs_.write(writer);
+}
+
+Error RleBitVector::push_back_bits(std::uint64_t bits, std::size_t num_bits) {
+  if (num_bits > 64) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to push bits: num_bits > 64");
+  }
+
+  if (num_bits != 64) {
+    bits &= (std::uint64_t(1) << num_bits) - 1;
+  }
+
+  // The bits are split into runs. A run ends at the lowest 1 of ~bits for a
+  // run of 1s, or of bits for a run of 0s.
+  while (num_bits != 0) {
+    const bool bit = (bits & 1) != 0;
+    const std::uint64_t rest = bit ? ~bits : bits;
+    std::size_t length = (rest != 0) ? SelectBit::lowest_bit(rest) : num_bits;
+    if (length > num_bits) {
+      length = num_bits;
+    }
+    Error error = push_back_run(bit, length);
+    if (error) {
+      return error;
+    }
+    bits = (length < 64) ? (bits >> length) : 0;
+    num_bits -= length;
+  }
+  return MARISA2_SUCCESS;
+}
+
+Error RleBitVector::push_back_run(bool bit, std::size_t num_bits) {
+  if (fixed_) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to push bits: already fixed");
+  } else if (num_bits > (std::numeric_limits<std::size_t>::max() - size_)) {
+    return MARISA2_ERROR(MARISA2_SIZE_ERROR, "failed to push bits: full");
+  } else if (num_bits == 0) {
+    return MARISA2_SUCCESS;
+  }
+
+  if (bit) {
+    // A new run starts unless the last bit is 1.
+    if ((num_runs_ == 0) || ((run_start(num_runs_ - 1)
+        + (num_1s_ - run_rank(num_runs_ - 1))) != size_)) {
+      Error error = runs_.push_back(Run{ size_, num_1s_ });
+      if (error) {
+        return error;
+      }
+      ++num_runs_;
+    }
+    num_1s_ += num_bits;
+  }
+  size_ += num_bits;
+  return MARISA2_SUCCESS;
+}
+
+Error RleBitVector::build() {
+  if (fixed_) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to build RLE bit vector: already fixed");
+  }
+
+  Error error = runs_.push_back(Run{ size_, num_1s_ });
+  if (error) {
+    return error;
+  }
+  error = runs_.shrink();
+  if (error) {
+    return error;
+  }
+  fixed_ = true;
+  return MARISA2_SUCCESS;
+}
+
+bool RleBitVector::operator[](std::size_t i) const {
+  const std::size_t count = find_run(i);
+  return (count != 0) &&
+      ((i - run_start(count - 1)) < run_length(count - 1));
+}
+
+std::size_t RleBitVector::rank_1(std::size_t i) const {
+  const std::size_t count = find_run(i);
+  if (count == 0) {
+    return 0;
+  }
+  const std::size_t offset = i - run_start(count - 1);
+  const std::size_t length = run_length(count - 1);
+  return run_rank(count - 1) + ((offset < length) ? offset : length);
+}
+
+std::size_t RleBitVector::select_1(std::size_t i) const {
+  // Find the last run whose rank is not greater than i.
+  std::size_t begin = 0;
+  std::size_t end = num_runs_;
+  while (begin < end) {
+    const std::size_t middle = (begin + end) / 2;
+    if (run_rank(middle) <= i) {
+      begin = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+  return run_start(begin - 1) + (i - run_rank(begin - 1));
+}
+
+std::size_t RleBitVector::select_0(std::size_t i) const {
+  // (start - rank) is the number of 0s before a run, and the (i + 1)-th 0
+  // follows the last run that has i or fewer 0s before it.
+  std::size_t begin = 0;
+  std::size_t end = num_runs_;
+  while (begin < end) {
+    const std::size_t middle = (begin + end) / 2;
+    if ((run_start(middle) - run_rank(middle)) <= i) {
+      begin = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+  if (begin == 0) {
+    return i;
+  }
+  const std::size_t run_id = begin - 1;
+  return run_start(run_id) + run_length(run_id)
+      + (i - (run_start(run_id) - run_rank(run_id)));
+}
+
+std::size_t RleBitVector::find_run(std::size_t i) const {
+  std::size_t begin = 0;
+  std::size_t end = num_runs_;
+  while (begin < end) {
+    const std::size_t middle = (begin + end) / 2;
+    if (run_start(middle) <= i) {
+      begin = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+  return begin;
+}
+
+}  // namespace grimoire
+}  // namespace marisa2
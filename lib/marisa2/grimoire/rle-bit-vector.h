@@ -0,0 +1,108 @@
+#ifndef MARISA2_GRIMOIRE_RLE_BIT_VECTOR_H
+#define MARISA2_GRIMOIRE_RLE_BIT_VECTOR_H
+
+#include "vector.h"
+
+namespace marisa2 {
+namespace grimoire {
+
+struct RleBitVectorHeader {
+  std::uint64_t size;
+  std::uint64_t num_1s;
+  std::uint64_t num_runs;
+};
+
+// RleBitVector is a run-length encoded bit vector. It stores the start and
+// the rank of each run of 1s, so that its size depends only on the number of
+// runs. rank_1/0() and select_1/0() take O(log(num_runs)) time.
+class MARISA2_DLL_EXPORT RleBitVector {
+ public:
+  RleBitVector() noexcept;
+  ~RleBitVector() noexcept;
+
+  RleBitVector(const RleBitVector &) = delete;
+  RleBitVector &operator=(const RleBitVector &) = delete;
+
+  explicit operator bool() const noexcept {
+    return size_ != 0;
+  }
+
+  Error map(Mapper &mapper, const RleBitVectorHeader &header) noexcept;
+  Error read(Reader &reader, const RleBitVectorHeader &header) noexcept;
+  Error write(Writer &writer) noexcept;
+
+  Error push_back(bool bit) noexcept {
+    return push_back_run(bit, 1);
+  }
+  // push_back_bits() appends the lower num_bits bits of bits, where num_bits
+  // must be in [0, 64], and push_back_run() appends num_bits copies of bit.
+  Error push_back_bits(std::uint64_t bits, std::size_t num_bits) noexcept;
+  Error push_back_run(bool bit, std::size_t num_bits) noexcept;
+
+  // build() makes the bit vector ready for queries. Bits cannot be appended
+  // after build().
+  Error build() noexcept;
+
+  bool operator[](std::size_t i) const noexcept;
+
+  // rank_1/0() and select_1/0() are available after build().
+  std::size_t rank_1(std::size_t i) const noexcept;
+  std::size_t rank_0(std::size_t i) const noexcept {
+    return i - rank_1(i);
+  }
+  std::size_t select_1(std::size_t i) const noexcept;
+  std::size_t select_0(std::size_t i) const noexcept;
+
+  std::size_t size() const noexcept {
+    return size_;
+  }
+  std::size_t num_1s() const noexcept {
+    return num_1s_;
+  }
+  std::size_t num_0s() const noexcept {
+    return size_ - num_1s_;
+  }
+  // num_runs() returns the number of runs of 1s.
+  std::size_t num_runs() const noexcept {
+    return num_runs_;
+  }
+  std::size_t total_size() const noexcept {
+    return runs_.size() * sizeof(Run);
+  }
+  RleBitVectorHeader header() const noexcept {
+    return RleBitVectorHeader{ size_, num_1s_, num_runs_ };
+  }
+
+ private:
+  // start is the position of the first 1 of a run, and rank is the number of
+  // 1s in the preceding runs. The last run is a sentinel whose start and rank
+  // are size() and num_1s().
+  struct Run {
+    std::uint64_t start;
+    std::uint64_t rank;
+  };
+
+  Vector<Run> runs_;
+  std::size_t size_;
+  std::size_t num_1s_;
+  std::size_t num_runs_;
+  bool fixed_;
+
+  std::size_t run_start(std::size_t run_id) const noexcept {
+    return static_cast<std::size_t>(runs_[run_id].start);
+  }
+  std::size_t run_rank(std::size_t run_id) const noexcept {
+    return static_cast<std::size_t>(runs_[run_id].rank);
+  }
+  std::size_t run_length(std::size_t run_id) const noexcept {
+    return run_rank(run_id + 1) - run_rank(run_id);
+  }
+
+  // find_run() returns the number of runs that start at or before i.
+  std::size_t find_run(std::size_t i) const noexcept;
+};
+
+}  // namespace grimoire
+}  // namespace marisa2
+
+#endif  // MARISA2_GRIMOIRE_RLE_BIT_VECTOR_H
@@ -0,0 +1,530 @@
+#include <limits>
+
+#include "rrr-bit-vector.h"
+
+namespace marisa2 {
+namespace grimoire {
+namespace {
+
+// BinomialTable has the binomial coefficients C(n, k) for n and k in
+// [0, 63], and the widths of offsets for classes in [0, 63]. C(n, k) for the
+// same k are contiguous because a block is decoded with a fixed k until a 1
+// is found.
+class BinomialTable {
+ public:
+  BinomialTable() noexcept : values_(), widths_() {
+    for (std::size_t n = 0; n < 64; ++n) {
+      values_[0][n] = 1;
+      for (std::size_t k = 1; k <= n; ++k) {
+        values_[k][n] = values_[k - 1][n - 1] + values_[k][n - 1];
+      }
+    }
+    // C(63, 31), the maximum, is less than 2^60.
+    for (std::size_t k = 0; k < 64; ++k) {
+      while ((std::uint64_t(1) << widths_[k]) < values_[k][63]) {
+        ++widths_[k];
+      }
+    }
+  }
+
+  std::uint64_t operator()(std::size_t n, std::size_t k) const noexcept {
+    return values_[k][n];
+  }
+  std::size_t width(std::size_t k) const noexcept {
+    return widths_[k];
+  }
+
+ private:
+  std::uint64_t values_[64][64];
+  std::size_t widths_[64];
+};
+
+// binomial() builds the table on the first call. Unlike a namespace-scope
+// object, it is ready even if called during the static initialization of
+// another translation unit.
+const BinomialTable &binomial() noexcept {
+  static const BinomialTable table;
+  return table;
+}
+
+}  // namespace
+
+constexpr std::size_t RrrBitVector::BLOCK_SIZE;
+constexpr std::size_t RrrBitVector::SAMPLE_INTERVAL;
+constexpr std::size_t RrrBitVector::SUBSAMPLE_INTERVAL;
+constexpr std::uint64_t RrrBitVector::REL_SHIFTS;
+constexpr std::uint64_t RrrBitVector::REL_WIDTHS;
+constexpr std::size_t RrrBitVector::CLASSES_PER_WORD;
+constexpr std::size_t RrrBitVector::MAX_SPARSE_CLASS;
+
+RrrBitVector::RrrBitVector()
+  : classes_(), offsets_(), samples_(), size_(0), num_1s_(0), num_blocks_(0),
+    num_offset_bits_(0), block_(0), fixed_(false) {}
+
+RrrBitVector::~RrrBitVector() {}
+
+Error RrrBitVector::map(Mapper &mapper, const RrrBitVectorHeader &header) {
+  if (header.size > std::numeric_limits<std::size_t>::max()) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to map RRR bit vector: too large");
+  } else if (header.num_1s > header.size) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to map RRR bit vector: invalid num_1s");
+  }
+  const std::size_t new_size = static_cast<std::size_t>(header.size);
+  const std::size_t new_num_blocks =
+      (new_size / BLOCK_SIZE) + ((new_size % BLOCK_SIZE) != 0);
+  if (header.num_offset_bits > (std::uint64_t(new_num_blocks) * 60)) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+        "failed to map RRR bit vector: invalid num_offset_bits");
+  }
+  const std::size_t new_num_offset_bits =
+      static_cast<std::size_t>(header.num_offset_bits);
+
+  Vector<std::uint64_t> new_classes;
+  Error error = new_classes.map(mapper, VectorHeader{
+      (new_num_blocks / CLASSES_PER_WORD)
+      + ((new_num_blocks % CLASSES_PER_WORD) != 0) });
+  if (error) {
+    return error;
+  }
+  Vector<std::uint64_t> new_offsets;
+  error = new_offsets.map(mapper, VectorHeader{
+      (new_num_offset_bits / 64) + ((new_num_offset_bits % 64) != 0) });
+  if (error) {
+    return error;
+  }
+  Vector<Sample> new_samples;
+  error = new_samples.map(mapper,
+                          VectorHeader{ num_samples(new_num_blocks) });
+  if (error) {
+    return error;
+  }
+  // The sentinel sample must agree with the header, or select_1/0() would
+  // scan past the last block.
+  if ((new_samples.back().rank != header.num_1s) ||
+      (new_samples.back().offset_pos != header.num_offset_bits)) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+        "failed to map RRR bit vector: invalid samples");
+  }
+
+  classes_.swap(new_classes);
+  offsets_.swap(new_offsets);
+  samples_.swap(new_samples);
+  size_ = new_size;
+  num_1s_ = static_cast<std::size_t>(header.num_1s);
+  num_blocks_ = new_num_blocks;
+  num_offset_bits_ = new_num_offset_bits;
+  block_ = 0;
+  fixed_ = true;
+  return MARISA2_SUCCESS;
+}
+
+Error RrrBitVector::read(Reader &reader, const RrrBitVectorHeader &header) {
+  if (header.size > std::numeric_limits<std::size_t>::max()) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to read RRR bit vector: too large");
+  } else if (header.num_1s > header.size) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+                         "failed to read RRR bit vector: invalid num_1s");
+  }
+  const std::size_t new_size = static_cast<std::size_t>(header.size);
+  const std::size_t new_num_blocks =
+      (new_size / BLOCK_SIZE) + ((new_size % BLOCK_SIZE) != 0);
+  if (header.num_offset_bits > (std::uint64_t(new_num_blocks) * 60)) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+        "failed to read RRR bit vector: invalid num_offset_bits");
+  }
+  const std::size_t new_num_offset_bits =
+      static_cast<std::size_t>(header.num_offset_bits);
+
+  Vector<std::uint64_t> new_classes;
+  Error error = new_classes.read(reader, VectorHeader{
+      (new_num_blocks / CLASSES_PER_WORD)
+      + ((new_num_blocks % CLASSES_PER_WORD) != 0) });
+  if (error) {
+    return error;
+  }
+  Vector<std::uint64_t> new_offsets;
+  error = new_offsets.read(reader, VectorHeader{
+      (new_num_offset_bits / 64) + ((new_num_offset_bits % 64) != 0) });
+  if (error) {
+    return error;
+  }
+  Vector<Sample> new_samples;
+  error = new_samples.read(reader,
+                           VectorHeader{ num_samples(new_num_blocks) });
+  if (error) {
+    return error;
+  }
+  // The sentinel sample must agree with the header, or select_1/0() would
+  // scan past the last block.
+  if ((new_samples.back().rank != header.num_1s) ||
+      (new_samples.back().offset_pos != header.num_offset_bits)) {
+    return MARISA2_ERROR(MARISA2_FORMAT_ERROR,
+        "failed to read RRR bit vector: invalid samples");
+  }
+
+  classes_.swap(new_classes);
+  offsets_.swap(new_offsets);
+  samples_.swap(new_samples);
+  size_ = new_size;
+  num_1s_ = static_cast<std::size_t>(header.num_1s);
+  num_blocks_ = new_num_blocks;
+  num_offset_bits_ = new_num_offset_bits;
+  block_ = 0;
+  fixed_ = true;
+  return MARISA2_SUCCESS;
+}
+
+Error RrrBitVector::write(Writer &writer) {
+  if (!fixed_) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to write RRR bit vector: not fixed");
+  }
+
+  Error error = classes_.write(writer);
+  if (error) {
+    return error;
+  }
+  error = offsets_.write(writer);
+  if (error) {
+    return error;
+  }
+  return samples_.write(writer);
+}
+
+Error RrrBitVector::push_back_bits(std::uint64_t bits, std::size_t num_bits) {
+  if (fixed_) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to push bits: already fixed");
+  }
+
+  if (num_bits > 64) {
+    return MARISA2_ERROR(MARISA2_RANGE_ERROR,
+                         "failed to push bits: num_bits > 64");
+  } else if (num_bits > (std::numeric_limits<std::size_t>::max() - size_)) {
+    return MARISA2_ERROR(MARISA2_SIZE_ERROR, "failed to push bits: full");
+  }
+
+  // The bits may straddle two blocks.
+  while (num_bits != 0) {
+    const std::size_t offset = size_ % BLOCK_SIZE;
+    const std::size_t count = (num_bits < (BLOCK_SIZE - offset)) ?
+        num_bits : (BLOCK_SIZE - offset);
+    block_ |= (bits & ((std::uint64_t(1) << count) - 1)) << offset;
+    bits >>= count;
+    num_bits -= count;
+    size_ += count;
+    if ((size_ % BLOCK_SIZE) == 0) {
+      Error error = push_block();
+      if (error) {
+        return error;
+      }
+    }
+  }
+  return MARISA2_SUCCESS;
+}
+
+Error RrrBitVector::build() {
+  if (fixed_) {
+    return MARISA2_ERROR(MARISA2_STATE_ERROR,
+                         "failed to build RRR bit vector: already fixed");
+  }
+
+  if ((size_ % BLOCK_SIZE) != 0) {
+    Error error = push_block();
+    if (error) {
+      return error;
+    }
+  }
+  // The sub-intervals after the last block point to the end.
+  if ((num_blocks_ % SAMPLE_INTERVAL) != 0) {
+    for (std::size_t sub_id = ((num_blocks_ % SAMPLE_INTERVAL)
+             + SUBSAMPLE_INTERVAL - 1) / SUBSAMPLE_INTERVAL;
+         sub_id < (SAMPLE_INTERVAL / SUBSAMPLE_INTERVAL); ++sub_id) {
+      set_rels(sub_id);
+    }
+  }
+  Error error = samples_.push_back(Sample{ num_1s_, num_offset_bits_, 0 });
+  if (error) {
+    return error;
+  }
+
+  error = classes_.shrink();
+  if (error) {
+    return error;
+  }
+  error = offsets_.shrink();
+  if (error) {
+    return error;
+  }
+  error = samples_.shrink();
+  if (error) {
+    return error;
+  }
+  fixed_ = true;
+  return MARISA2_SUCCESS;
+}
+
+bool RrrBitVector::operator[](std::size_t i) const {
+  const std::size_t block_id = i / BLOCK_SIZE;
+  const std::size_t block_class = get_class(block_id);
+  if ((block_class == 0) || (block_class == BLOCK_SIZE)) {
+    return block_class != 0;
+  }
+  std::size_t rank, pos;
+  locate(block_id, &rank, &pos);
+  const std::uint64_t block =
+      decode_block(block_id, pos, (i % BLOCK_SIZE) + 1);
+  return (block >> (i % BLOCK_SIZE)) & 1;
+}
+
+std::size_t RrrBitVector::rank_1(std::size_t i) const {
+  const std::size_t block_id = i / BLOCK_SIZE;
+  std::size_t rank, pos;
+  locate(block_id, &rank, &pos);
+  if ((i % BLOCK_SIZE) != 0) {
+    rank += PopCount::pop_count(
+        decode_block(block_id, pos, i % BLOCK_SIZE));
+  }
+  return rank;
+}
+
+std::size_t RrrBitVector::select_1(std::size_t i) const {
+  const BinomialTable &table = binomial();
+  // Find the last sample whose rank is not greater than i, then the last
+  // sub-interval in the same way, and then scan the blocks in it.
+  std::size_t begin = 0;
+  std::size_t end = samples_.size() - 1;
+  while (begin < end) {
+    const std::size_t middle = (begin + end + 1) / 2;
+    if (samples_[middle].rank <= i) {
+      begin = middle;
+    } else {
+      end = middle - 1;
+    }
+  }
+  const Sample &sample = samples_[begin];
+  std::size_t rank = static_cast<std::size_t>(sample.rank);
+  std::size_t sub_id = 0;
+  for (std::size_t j = 1; j < (SAMPLE_INTERVAL / SUBSAMPLE_INTERVAL); ++j) {
+    sub_id += (rank + rel_rank(sample, j)) <= i;
+  }
+
+  std::size_t block_id = (begin * SAMPLE_INTERVAL)
+      + (sub_id * SUBSAMPLE_INTERVAL);
+  rank += rel_rank(sample, sub_id);
+  std::size_t pos = static_cast<std::size_t>(sample.offset_pos)
+      + rel_pos(sample, sub_id);
+  for ( ; ; ++block_id) {
+    const std::size_t block_class = get_class(block_id);
+    if ((rank + block_class) > i) {
+      break;
+    }
+    rank += block_class;
+    pos += table.width(block_class);
+  }
+  return (block_id * BLOCK_SIZE)
+      + SelectBit::select_bit(decode_block(block_id, pos), i - rank);
+}
+
+std::size_t RrrBitVector::select_0(std::size_t i) const {
+  const BinomialTable &table = binomial();
+  // The number of 0s in the preceding blocks is given by
+  // (BLOCK_SIZE * block_id) - rank.
+  std::size_t begin = 0;
+  std::size_t end = samples_.size() - 1;
+  while (begin < end) {
+    const std::size_t middle = (begin + end + 1) / 2;
+    if (((middle * SAMPLE_INTERVAL * BLOCK_SIZE) - samples_[middle].rank)
+        <= i) {
+      begin = middle;
+    } else {
+      end = middle - 1;
+    }
+  }
+  const Sample &sample = samples_[begin];
+  std::size_t rank = (begin * SAMPLE_INTERVAL * BLOCK_SIZE)
+      - static_cast<std::size_t>(sample.rank);
+  std::size_t sub_id = 0;
+  for (std::size_t j = 1; j < (SAMPLE_INTERVAL / SUBSAMPLE_INTERVAL); ++j) {
+    sub_id += (rank + (j * SUBSAMPLE_INTERVAL * BLOCK_SIZE)
+               - rel_rank(sample, j)) <= i;
+  }
+
+  std::size_t block_id = (begin * SAMPLE_INTERVAL)
+      + (sub_id * SUBSAMPLE_INTERVAL);
+  rank += (sub_id * SUBSAMPLE_INTERVAL * BLOCK_SIZE) - rel_rank(sample, sub_id);
+  std::size_t pos = static_cast<std::size_t>(sample.offset_pos)
+      + rel_pos(sample, sub_id);
+  for ( ; ; ++block_id) {
+    const std::size_t block_class = get_class(block_id);
+    if ((rank + (BLOCK_SIZE - block_class)) > i) {
+      break;
+    }
+    rank += BLOCK_SIZE - block_class;
+    pos += table.width(block_class);
+  }
+  return (block_id * BLOCK_SIZE)
+      + SelectBit::select_bit(~decode_block(block_id, pos), i - rank);
+}
+
+std::uint64_t RrrBitVector::block_offset(std::size_t pos,
+                                         std::size_t width) const {
+  if (width == 0) {
+    return 0;
+  }
+  const std::size_t unit_id = pos / 64;
+  const std::size_t shift = pos % 64;
+  std::uint64_t offset = offsets_[unit_id] >> shift;
+  if ((shift + width) > 64) {
+    offset |= offsets_[unit_id + 1] << (64 - shift);
+  }
+  return offset & ((std::uint64_t(1) << width) - 1);
+}
+
+std::uint64_t RrrBitVector::decode_block(std::size_t block_id,
+                                         std::size_t offset_pos,
+                                         std::size_t num_bits) const {
+  const BinomialTable &table = binomial();
+  std::size_t block_class = get_class(block_id);
+  std::uint64_t offset =
+      block_offset(offset_pos, table.width(block_class));
+
+  // The combinations of the complement are in the reverse order, so a
+  // block with more 1s than 0s is decoded as its complement.
+  std::uint64_t flip = 0;
+  if (block_class > (BLOCK_SIZE / 2)) {
+    offset = table(BLOCK_SIZE, block_class) - 1 - offset;
+    block_class = BLOCK_SIZE - block_class;
+    flip = (std::uint64_t(1) << num_bits) - 1;
+  }
+
+  std::uint64_t block = 0;
+  if (block_class <= MAX_SPARSE_CLASS) {
+    // The j-th bit is the first 1 iff C(BLOCK_SIZE - 1 - j, block_class) is
+    // the largest of the counts not greater than the offset. The counts
+    // increase with n = BLOCK_SIZE - 1 - j, so each 1 is found by a binary
+    // search over n in [block_class - 1, end) instead of a scan of 0s.
+    std::size_t end = BLOCK_SIZE;
+    for ( ; block_class != 0; --block_class) {
+      std::size_t n = block_class - 1;
+      std::size_t length = end - n;
+      while (length > 1) {
+        const std::size_t half = length / 2;
+        if (table(n + half, block_class) <= offset) {
+          n += half;
+        }
+        length -= half;
+      }
+      if ((BLOCK_SIZE - 1 - n) >= num_bits) {
+        break;
+      }
+      block |= std::uint64_t(1) << (BLOCK_SIZE - 1 - n);
+      offset -= table(n, block_class);
+      end = n;
+    }
+  } else {
+    // The j-th bit is 1 iff the offset is not less than the number of the
+    // combinations where the j-th bit is 0. The bits are decoded without
+    // branches because they are hard to predict in such a block.
+    for (std::size_t j = 0; (j < num_bits) && (block_class != 0); ++j) {
+      const std::uint64_t count = table(BLOCK_SIZE - 1 - j, block_class);
+      const std::uint64_t mask = std::uint64_t(0) - (offset >= count);
+      block |= mask & (std::uint64_t(1) << j);
+      offset -= mask & count;
+      block_class -= static_cast<std::size_t>(mask & 1);
+    }
+  }
+  return block ^ flip;
+}
+
+void RrrBitVector::locate(std::size_t block_id, std::size_t *rank,
+                          std::size_t *offset_pos) const {
+  const BinomialTable &table = binomial();
+  const Sample &sample = samples_[block_id / SAMPLE_INTERVAL];
+  const std::size_t sub_id =
+      (block_id % SAMPLE_INTERVAL) / SUBSAMPLE_INTERVAL;
+  std::size_t new_rank = static_cast<std::size_t>(sample.rank)
+      + rel_rank(sample, sub_id);
+  std::size_t new_offset_pos = static_cast<std::size_t>(sample.offset_pos)
+      + rel_pos(sample, sub_id);
+  for (std::size_t j = block_id - (block_id % SUBSAMPLE_INTERVAL);
+       j < block_id; ++j) {
+    const std::size_t block_class = get_class(j);
+    new_rank += block_class;
+    new_offset_pos += table.width(block_class);
+  }
+  *rank = new_rank;
+  *offset_pos = new_offset_pos;
+}
+
+Error RrrBitVector::push_block() {
+  const BinomialTable &table = binomial();
+  if ((num_blocks_ % SAMPLE_INTERVAL) == 0) {
+    Error error = samples_.push_back(Sample{ num_1s_, num_offset_bits_, 0 });
+    if (error) {
+      return error;
+    }
+  } else if ((num_blocks_ % SUBSAMPLE_INTERVAL) == 0) {
+    set_rels((num_blocks_ % SAMPLE_INTERVAL) / SUBSAMPLE_INTERVAL);
+  }
+
+  // The offset is the sum of the numbers of the combinations that precede
+  // the block, which is the inverse of decode_block().
+  const std::size_t block_class = PopCount::pop_count(block_);
+  std::uint64_t offset = 0;
+  for (std::size_t j = 0, k = block_class; k != 0; ++j) {
+    if ((block_ >> j) & 1) {
+      offset += table(BLOCK_SIZE - 1 - j, k);
+      --k;
+    }
+  }
+
+  const std::size_t shift = (num_blocks_ % CLASSES_PER_WORD) * 6;
+  if (shift == 0) {
+    Error error = classes_.push_back(block_class);
+    if (error) {
+      return error;
+    }
+  } else {
+    classes_.back() |= std::uint64_t(block_class) << shift;
+  }
+
+  const std::size_t width = table.width(block_class);
+  if (width != 0) {
+    const std::size_t offset_shift = num_offset_bits_ % 64;
+    if (offset_shift == 0) {
+      Error error = offsets_.push_back(offset);
+      if (error) {
+        return error;
+      }
+    } else {
+      offsets_.back() |= offset << offset_shift;
+      if ((offset_shift + width) > 64) {
+        Error error = offsets_.push_back(offset >> (64 - offset_shift));
+        if (error) {
+          return error;
+        }
+      }
+    }
+    num_offset_bits_ += width;
+  }
+
+  num_1s_ += block_class;
+  ++num_blocks_;
+  block_ = 0;
+  return MARISA2_SUCCESS;
+}
+
+void RrrBitVector::set_rels(std::size_t sub_id) {
+  Sample &sample = samples_.back();
+  const std::size_t shift =
+      static_cast<std::size_t>((REL_SHIFTS >> (sub_id * 8)) & 0xFF);
+  sample.rels |= (num_1s_ - sample.rank) << shift;
+  sample.rels |= (num_offset_bits_ - sample.offset_pos) << (shift + 32);
+}
+
+}  // namespace grimoire
+}  // namespace marisa2
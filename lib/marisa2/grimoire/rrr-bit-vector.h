@@ -0,0 +1,165 @@
+#ifndef MARISA2_GRIMOIRE_RRR_BIT_VECTOR_H
+#define MARISA2_GRIMOIRE_RRR_BIT_VECTOR_H
+
+#include "pop-count.h"
+#include "select-bit.h"
+#include "vector.h"
+
+namespace marisa2 {
+namespace grimoire {
+
+struct RrrBitVectorHeader {
+  std::uint64_t size;
+  std::uint64_t num_1s;
+  std::uint64_t num_offset_bits;
+};
+
+// RrrBitVector is a compressed bit vector of Raman, Raman, and Rao. Bits are
+// split into 63-bit blocks, and each block is encoded as a pair of its class,
+// the number of 1s, and its offset, the index of the block in all the blocks
+// of the class. An offset of a block with very few or very many 1s is short,
+// so a skewed bit vector is much smaller than BitVector.
+// RrrBitVector provides the same queries as BitVector, but they are slower
+// because a block is decoded from its offset.
+class MARISA2_DLL_EXPORT RrrBitVector {
+ public:
+  RrrBitVector() noexcept;
+  ~RrrBitVector() noexcept;
+
+  RrrBitVector(const RrrBitVector &) = delete;
+  RrrBitVector &operator=(const RrrBitVector &) = delete;
+
+  explicit operator bool() const noexcept {
+    return size_ != 0;
+  }
+
+  Error map(Mapper &mapper, const RrrBitVectorHeader &header) noexcept;
+  Error read(Reader &reader, const RrrBitVectorHeader &header) noexcept;
+  Error write(Writer &writer) noexcept;
+
+  Error push_back(bool bit) noexcept {
+    return push_back_bits(bit, 1);
+  }
+  // push_back_bits() appends the lower num_bits bits of bits, where num_bits
+  // must be in [0, 64].
+  Error push_back_bits(std::uint64_t bits, std::size_t num_bits) noexcept;
+
+  // build() encodes the last block and makes the bit vector ready for
+  // queries. Bits cannot be appended after build().
+  Error build() noexcept;
+
+  bool operator[](std::size_t i) const noexcept;
+
+  // rank_1/0() and select_1/0() are available after build().
+  std::size_t rank_1(std::size_t i) const noexcept;
+  std::size_t rank_0(std::size_t i) const noexcept {
+    return i - rank_1(i);
+  }
+  std::size_t select_1(std::size_t i) const noexcept;
+  std::size_t select_0(std::size_t i) const noexcept;
+
+  std::size_t size() const noexcept {
+    return size_;
+  }
+  std::size_t num_1s() const noexcept {
+    return num_1s_;
+  }
+  std::size_t num_0s() const noexcept {
+    return size_ - num_1s_;
+  }
+  // total_size() returns the number of bytes used by the encoded bits and
+  // the directory.
+  std::size_t total_size() const noexcept {
+    return (classes_.size() * sizeof(std::uint64_t))
+        + (offsets_.size() * sizeof(std::uint64_t))
+        + (samples_.size() * sizeof(Sample));
+  }
+  RrrBitVectorHeader header() const noexcept {
+    return RrrBitVectorHeader{ size_, num_1s_, num_offset_bits_ };
+  }
+
+ private:
+  // A sample is taken for every SAMPLE_INTERVAL blocks. rank is the number of
+  // 1s in the preceding blocks, and offset_pos is the position of the offset
+  // of the first block. The last sample is a sentinel, whose rank and
+  // offset_pos are num_1s_ and num_offset_bits_.
+  // rels has the ranks and the offset positions of the first blocks of the
+  // sub-intervals, each of which has SUBSAMPLE_INTERVAL blocks, relative to
+  // the sample. The ranks are in the lower 32 bits and the offset positions
+  // are in the upper 32 bits.
+  struct Sample {
+    std::uint64_t rank;
+    std::uint64_t offset_pos;
+    std::uint64_t rels;
+  };
+
+  static constexpr std::size_t BLOCK_SIZE = 63;
+  static constexpr std::size_t SAMPLE_INTERVAL = 32;
+  static constexpr std::size_t SUBSAMPLE_INTERVAL = 8;
+  // The i-th bytes of REL_SHIFTS/WIDTHS are for the i-th sub-interval. The
+  // relative values of the sub-intervals 1-3 have 9, 10, and 11 bits, which
+  // are enough for 8, 16, and 24 blocks of 63 1s or 60-bit offsets.
+  static constexpr std::uint64_t REL_SHIFTS = 0x13090000ULL;
+  static constexpr std::uint64_t REL_WIDTHS = 0x0B0A0900ULL;
+  // A 6-bit class is stored in one of the lower 60 bits of a 64-bit word.
+  static constexpr std::size_t CLASSES_PER_WORD = 10;
+  // decode_block() finds each 1 by a binary search in a block with at most
+  // MAX_SPARSE_CLASS 1s or 0s, and scans the other blocks.
+  static constexpr std::size_t MAX_SPARSE_CLASS = 8;
+
+  Vector<std::uint64_t> classes_;
+  Vector<std::uint64_t> offsets_;
+  Vector<Sample> samples_;
+  std::size_t size_;
+  std::size_t num_1s_;
+  std::size_t num_blocks_;
+  std::size_t num_offset_bits_;
+  // block_ has the bits of the last block until it is filled.
+  std::uint64_t block_;
+  bool fixed_;
+
+  std::size_t get_class(std::size_t block_id) const noexcept {
+    return static_cast<std::size_t>(
+        (classes_[block_id / CLASSES_PER_WORD]
+         >> ((block_id % CLASSES_PER_WORD) * 6)) & 0x3F);
+  }
+  std::uint64_t block_offset(std::size_t pos,
+                             std::size_t width) const noexcept;
+
+  // rel_rank/pos() return the rank and the offset position of the first
+  // block of the sub_id-th sub-interval relative to sample.
+  static std::size_t rel_rank(const Sample &sample,
+                              std::size_t sub_id) noexcept {
+    return static_cast<std::size_t>(
+        (sample.rels >> ((REL_SHIFTS >> (sub_id * 8)) & 0xFF))
+        & ((std::uint64_t(1) << ((REL_WIDTHS >> (sub_id * 8)) & 0xFF)) - 1));
+  }
+  static std::size_t rel_pos(const Sample &sample,
+                             std::size_t sub_id) noexcept {
+    return static_cast<std::size_t>(
+        (sample.rels >> (((REL_SHIFTS >> (sub_id * 8)) & 0xFF) + 32))
+        & ((std::uint64_t(1) << ((REL_WIDTHS >> (sub_id * 8)) & 0xFF)) - 1));
+  }
+
+  // decode_block() returns the lower num_bits bits of the block at block_id,
+  // where num_bits must be in [0, 63]. It requires the position of its
+  // offset, which is found by locate().
+  std::uint64_t decode_block(std::size_t block_id, std::size_t offset_pos,
+                             std::size_t num_bits = BLOCK_SIZE) const noexcept;
+  // locate() returns the rank and the offset position of the block at
+  // block_id. It scans at most SUBSAMPLE_INTERVAL - 1 blocks.
+  void locate(std::size_t block_id, std::size_t *rank,
+              std::size_t *offset_pos) const noexcept;
+
+  Error push_block() noexcept;
+  void set_rels(std::size_t sub_id) noexcept;
+
+  static std::size_t num_samples(std::size_t num_blocks) noexcept {
+    return ((num_blocks + SAMPLE_INTERVAL - 1) / SAMPLE_INTERVAL) + 1;
+  }
+};
+
+}  // namespace grimoire
+}  // namespace marisa2
+
+#endif  // MARISA2_GRIMOIRE_RRR_BIT_VECTOR_H
@@ -0,0 +1,89 @@
+#ifndef MARISA2_GRIMOIRE_SELECT_BIT_H
+#define MARISA2_GRIMOIRE_SELECT_BIT_H
+
+#include <cstddef>
+
+#include "../features.h"
+#include "pop-count.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+# define MARISA2_HAS_BMI2_DISPATCH
+# ifdef __BMI2__
+#  include <immintrin.h>
+# endif  // __BMI2__
+#endif  // defined(__x86_64__) && defined(__GNUC__)
+
+namespace marisa2 {
+namespace grimoire {
+
+class MARISA2_DLL_EXPORT SelectBit {
+ public:
+  SelectBit() = delete;
+  ~SelectBit() = delete;
+
+  // select_bit() returns the position of the (i + 1)-th 1 in x.
+  // If x has i or fewer 1s, the result is undefined.
+  // PDEP and TZCNT (BMI2) are used if the running CPU supports them, so that
+  // one binary works well on both old and new CPUs.
+  static std::size_t select_bit(std::uint64_t x, std::size_t i) noexcept {
+#if defined(MARISA2_HAS_BMI2_DISPATCH) && defined(__BMI2__)
+    return static_cast<std::size_t>(
+        _tzcnt_u64(_pdep_u64(std::uint64_t(1) << i, x)));
+#else  // defined(MARISA2_HAS_BMI2_DISPATCH) && defined(__BMI2__)
+    return uses_bmi2_ ? select_bit_bmi2(x, i) : select_bit_broadword(x, i);
+#endif  // defined(MARISA2_HAS_BMI2_DISPATCH) && defined(__BMI2__)
+  }
+
+  // lowest_bit() and highest_bit() return the positions of the lowest and
+  // the highest 1s in x, which must not be 0.
+  static std::size_t lowest_bit(std::uint64_t x) noexcept {
+#ifdef __GNUC__
+    return static_cast<std::size_t>(__builtin_ctzll(x));
+#else  // __GNUC__
+    return select_bit(x, 0);
+#endif  // __GNUC__
+  }
+  static std::size_t highest_bit(std::uint64_t x) noexcept {
+#ifdef __GNUC__
+    return static_cast<std::size_t>(63 - __builtin_clzll(x));
+#else  // __GNUC__
+    return select_bit(x, PopCount::pop_count(x) - 1);
+#endif  // __GNUC__
+  }
+
+  // uses_bmi2() returns whether select_bit() uses PDEP and TZCNT.
+  static bool uses_bmi2() noexcept {
+    return uses_bmi2_;
+  }
+
+  // The following functions are the implementations of select_bit().
+  // select_bit_bmi2() must not be called if uses_bmi2() returns false.
+  static std::size_t select_bit_bmi2(std::uint64_t x, std::size_t i) noexcept;
+  static std::size_t select_bit_broadword(std::uint64_t x,
+                                          std::size_t i) noexcept {
+    // Each byte of counts is in [0, 64], so MASK_80 works as a borrow guard.
+    // The j-th byte of guards has its MSB iff the j-th count <= i, and thus
+    // the number of such bytes is the index of the byte that has the answer.
+    const std::uint64_t counts = PopCount(x).value();
+    const std::uint64_t guards = ((i * MASK_01) | MASK_80) - counts;
+    const std::size_t shift = static_cast<std::size_t>(
+        ((((guards & MASK_80) >> 7) * MASK_01) >> 56) << 3);
+    const std::size_t rank = static_cast<std::size_t>(
+        ((counts << 8) >> shift) & 0xFF);
+    return shift + SELECT_TABLE[i - rank][(x >> shift) & 0xFF];
+  }
+
+ private:
+  static const bool uses_bmi2_;
+
+  static constexpr std::uint64_t MASK_01 = 0x0101010101010101ULL;
+  static constexpr std::uint64_t MASK_80 = 0x8080808080808080ULL;
+
+  // SELECT_TABLE[i][x] is the position of the (i + 1)-th 1 in a byte x.
+  static const std::uint8_t SELECT_TABLE[8][256];
+};
+
+}  // namespace grimoire
+}  // namespace marisa2
+
+#endif  // MARISA2_GRIMOIRE_SELECT_BIT_H
@@ -1,11 +1,26 @@
+#include <cstdint>
 #include <cstring>
 #include <limits>
 #include <new>
+#include <utility>
 
 #include "vector.h"
 
 namespace marisa2 {
 namespace grimoire {
+namespace {
+
+// Heap buffers are aligned to cache lines, so that a 64-byte object, such as
+// a line of BitVector, never straddles cache lines.
+constexpr std::size_t ALIGNMENT = 64;
+
+void *align_address(char *buf) noexcept {
+  const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(buf);
+  return reinterpret_cast<void *>(
+      (address + (ALIGNMENT - 1)) & ~std::uintptr_t(ALIGNMENT - 1));
+}
+
+}  // namespace
 
 VectorImpl::VectorImpl(std::size_t obj_size)
   : address_(nullptr), size_(0), capacity_(0), buf_(), obj_size_(obj_size) {}
@@ -42,26 +57,30 @@ Error VectorImpl::read(Reader &reader, const VectorHeader &header) {
   }
 
   const std::size_t new_size = static_cast<std::size_t>(header.size);
-  if (new_size > (std::numeric_limits<std::size_t>::max() / obj_size_)) {
+  if (new_size > ((std::numeric_limits<std::size_t>::max() - ALIGNMENT)
+                  / obj_size_)) {
     return MARISA2_ERROR(MARISA2_RANGE_ERROR,
                          "failed to read vector: too large");
   }
 
   std::unique_ptr<char[]> new_buf;
+  void *new_address = nullptr;
   if (new_size != 0) {
-    new_buf.reset(new (std::nothrow) char[obj_size_ * new_size]);
+    new_buf.reset(new (std::nothrow) char[(obj_size_ * new_size) + ALIGNMENT]);
     if (!new_buf) {
       return MARISA2_ERROR(MARISA2_MEMORY_ERROR,
                            "failed to read vector: new char[] failed");
     }
+    new_address = align_address(new_buf.get());
   }
 
-  Error error = reader.read(new_buf.get(), obj_size_ * new_size);
+  Error error = reader.read(static_cast<char *>(new_address),
+                            obj_size_ * new_size);
   if (error) {
     return error;
   }
 
-  address_ = new_buf.get();
+  address_ = new_address;
   size_ = new_size;
   capacity_ = new_size;
   buf_ = std::move(new_buf);
@@ -85,26 +104,39 @@ Error VectorImpl::reserve(std::size_t new_size) {
 }
 
 Error VectorImpl::reallocate(std::size_t new_size) {
-  if (new_size > (std::numeric_limits<std::size_t>::max() / obj_size_)) {
+  if (new_size > ((std::numeric_limits<std::size_t>::max() - ALIGNMENT)
+                  / obj_size_)) {
     return MARISA2_ERROR(MARISA2_RANGE_ERROR,
                          "failed to reallocate vector: too large");
   }
 
   std::unique_ptr<char[]> new_buf;
+  void *new_address = nullptr;
   if (new_size != 0) {
-    new_buf.reset(new (std::nothrow) char[obj_size_ * new_size]);
+    new_buf.reset(new (std::nothrow) char[(obj_size_ * new_size) + ALIGNMENT]);
     if (!new_buf) {
       return MARISA2_ERROR(MARISA2_MEMORY_ERROR,
                            "failed to reallocate vector: new char[] failed");
     }
+    new_address = align_address(new_buf.get());
   }
 
-  std::memcpy(new_buf.get(), address_, obj_size_ * size_);
-  address_ = new_buf.get();
+  if (size_ > new_size) {
+    size_ = new_size;
+  }
+  std::memcpy(new_address, address_, obj_size_ * size_);
+  address_ = new_address;
   capacity_ = new_size;
   buf_ = std::move(new_buf);
   return MARISA2_SUCCESS;
 }
 
+void VectorImpl::swap(VectorImpl &rhs) {
+  std::swap(address_, rhs.address_);
+  std::swap(size_, rhs.size_);
+  std::swap(capacity_, rhs.capacity_);
+  buf_.swap(rhs.buf_);
+}
+
 }  // namespace grimoire
 }  // namespace marisa2
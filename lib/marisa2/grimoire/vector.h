@@ -42,11 +42,18 @@ class MARISA2_DLL_EXPORT VectorImpl {
   std::size_t capacity() const noexcept {
     return capacity_;
   }
+  // is_mapped() returns whether the objects are in memory given by map().
+  bool is_mapped() const noexcept {
+    return (address_ != nullptr) && !buf_;
+  }
 
   void set_size(std::size_t new_size) noexcept {
     size_ = new_size;
   }
 
+  // swap() requires that rhs has the same object size.
+  void swap(VectorImpl &rhs) noexcept;
+
  private:
   void *address_;
   std::size_t size_;
@@ -142,6 +149,10 @@ class Vector {
     return MARISA2_SUCCESS;
   }
 
+  void swap(Vector &rhs) noexcept {
+    impl_.swap(rhs.impl_);
+  }
+
   const T &operator[](std::size_t i) const noexcept {
     return static_cast<const T *>(impl_.address())[i];
   }
@@ -181,6 +192,9 @@ class Vector {
   std::size_t capacity() const noexcept {
     return impl_.capacity();
   }
+  bool is_mapped() const noexcept {
+    return impl_.is_mapped();
+  }
   VectorHeader header() const noexcept {
     return VectorHeader{ impl_.size() };
   }
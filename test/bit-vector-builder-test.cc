@@ -0,0 +1,139 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <marisa2/grimoire/bit-vector-builder.h>
+
+class BitVectorBuilderTest : public testing::Test {
+ protected:
+  // This function is called before each test.
+  virtual void SetUp() {
+  }
+
+  // This function is called after each test.
+  virtual void TearDown() {
+  }
+
+  static std::mt19937_64 random_;
+};
+
+std::mt19937_64 BitVectorBuilderTest::random_;
+
+TEST_F(BitVectorBuilderTest, DefaultConstructor) {
+  marisa2::grimoire::BitVectorBuilder builder;
+
+  ASSERT_FALSE(static_cast<bool>(builder));
+  ASSERT_EQ(0U, builder.size());
+  ASSERT_EQ(0U, builder.num_1s());
+}
+
+TEST_F(BitVectorBuilderTest, State) {
+  marisa2::Error error;
+  marisa2::grimoire::BitVectorBuilder builder;
+  marisa2::grimoire::BitVectorHeader header;
+
+  error = builder.push_back(true);
+  ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+  error = builder.finish(&header);
+  ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+
+  std::stringstream stream;
+  marisa2::grimoire::Writer writer;
+  error = writer.open(stream);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+  error = builder.open(writer, 9 << 8);
+  ASSERT_EQ(MARISA2_RANGE_ERROR, error.code()) << error.message();
+  ASSERT_FALSE(static_cast<bool>(builder));
+  error = builder.open(writer);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  ASSERT_TRUE(static_cast<bool>(builder));
+  error = builder.open(writer);
+  ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+  error = builder.push_back_bits(0, 65);
+  ASSERT_EQ(MARISA2_RANGE_ERROR, error.code()) << error.message();
+  error = builder.finish(nullptr);
+  ASSERT_EQ(MARISA2_NULL_ERROR, error.code()) << error.message();
+
+  error = builder.finish(&header);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  ASSERT_FALSE(static_cast<bool>(builder));
+  ASSERT_EQ(0U, header.size);
+  ASSERT_EQ(0U, header.num_1s);
+  ASSERT_EQ(static_cast<std::uint64_t>(MARISA2_ENABLE_RANK), header.flags);
+}
+
+TEST_F(BitVectorBuilderTest, SameAsBitVector) {
+  // A streamed bit vector must be the same as a built one.
+  const std::size_t sizes[] = { 0, 1, 64, 255, 256, 257, 448, 1000, 1 << 20 };
+  const double densities[] = { 0.01, 0.5, 0.99 };
+  const int flags[] = {
+    0, MARISA2_CACHE_LINE_LAYOUT, MARISA2_WIDE_INDEX,
+    MARISA2_CACHE_LINE_LAYOUT | MARISA2_WIDE_INDEX,
+    MARISA2_SELECT_INTERVAL_64,
+    MARISA2_CACHE_LINE_LAYOUT | MARISA2_SELECT_INTERVAL_8192
+  };
+  for (int flag : flags) {
+    for (std::size_t size : sizes) {
+      for (double density : densities) {
+        marisa2::Error error;
+        const int build_flags =
+            MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0 | flag;
+
+        std::stringstream stream;
+        marisa2::grimoire::Writer writer;
+        error = writer.open(stream);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        marisa2::grimoire::BitVectorBuilder builder;
+        error = builder.open(writer, build_flags);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+        marisa2::grimoire::BitVector bit_vector;
+        std::bernoulli_distribution distribution(density);
+        for (std::size_t i = 0; i < size; ) {
+          // Bits are pushed in random lengths.
+          std::size_t num_bits = random_() % 65;
+          num_bits = std::min(num_bits, size - i);
+          std::uint64_t bits = 0;
+          for (std::size_t j = 0; j < num_bits; ++j) {
+            bits |= std::uint64_t(distribution(random_)) << j;
+          }
+          error = builder.push_back_bits(bits, num_bits);
+          ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+          error = bit_vector.push_back_bits(bits, num_bits);
+          ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+          i += num_bits;
+        }
+        ASSERT_EQ(size, builder.size());
+
+        marisa2::grimoire::BitVectorHeader header;
+        error = builder.finish(&header);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        error = writer.flush();
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+        error = bit_vector.build(build_flags);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        ASSERT_EQ(bit_vector.header().size, header.size);
+        ASSERT_EQ(bit_vector.header().num_1s, header.num_1s);
+        ASSERT_EQ(bit_vector.header().flags, header.flags);
+
+        std::stringstream expected;
+        marisa2::grimoire::Writer expected_writer;
+        error = expected_writer.open(expected);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        error = bit_vector.write(expected_writer);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        error = expected_writer.flush();
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+        ASSERT_TRUE(expected.str() == stream.str())
+            << flag << ' ' << size << ' ' << density;
+      }
+    }
+  }
+}
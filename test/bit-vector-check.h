@@ -0,0 +1,33 @@
+#ifndef MARISA2_TEST_BIT_VECTOR_CHECK_H
+#define MARISA2_TEST_BIT_VECTOR_CHECK_H
+
+#include <cstddef>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+// CheckBitVector() compares operator[], rank_1/0(), select_1/0(), and the
+// counts of bit_vector with bits. BitVectorT is any bit vector that provides
+// these queries, such as RrrBitVector and DynamicBitVector.
+template <typename BitVectorT>
+void CheckBitVector(const BitVectorT &bit_vector,
+                    const std::vector<bool> &bits) {
+  ASSERT_EQ(bits.size(), bit_vector.size());
+  std::size_t num_1s = 0;
+  for (std::size_t i = 0; i < bits.size(); ++i) {
+    ASSERT_EQ(bits[i], bit_vector[i]) << i;
+    ASSERT_EQ(num_1s, bit_vector.rank_1(i)) << i;
+    ASSERT_EQ(i - num_1s, bit_vector.rank_0(i)) << i;
+    if (bits[i]) {
+      ASSERT_EQ(i, bit_vector.select_1(num_1s)) << i;
+      ++num_1s;
+    } else {
+      ASSERT_EQ(i, bit_vector.select_0(i - num_1s)) << i;
+    }
+  }
+  ASSERT_EQ(num_1s, bit_vector.rank_1(bits.size()));
+  ASSERT_EQ(num_1s, bit_vector.num_1s());
+  ASSERT_EQ(bits.size() - num_1s, bit_vector.num_0s());
+}
+
+#endif  // MARISA2_TEST_BIT_VECTOR_CHECK_H
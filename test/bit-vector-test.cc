@@ -1,6 +1,11 @@
 #include "gtest/gtest.h"
 
+#include <algorithm>
 #include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <marisa2/grimoire/bit-vector.h>
 
@@ -13,8 +18,17 @@ class BitVectorTest : public testing::Test {
   // This function is called after each test.
   virtual void TearDown() {
   }
+
+  static constexpr std::size_t NUM_BITS = 1 << 18;
+  static constexpr int LAYOUTS[] = { 0, MARISA2_CACHE_LINE_LAYOUT };
+
+  static std::mt19937_64 random_;
 };
 
+constexpr std::size_t BitVectorTest::NUM_BITS;
+constexpr int BitVectorTest::LAYOUTS[];
+std::mt19937_64 BitVectorTest::random_;
+
 TEST_F(BitVectorTest, DefaultConstructor) {
   marisa2::grimoire::BitVector bit_vector;
   ASSERT_FALSE(static_cast<bool>(bit_vector));
@@ -24,15 +38,302 @@ TEST_F(BitVectorTest, DefaultConstructor) {
 }
 
 TEST_F(BitVectorTest, Map) {
-  // TODO
+  std::vector<std::uint64_t> words(NUM_BITS / 64);
+  for (std::uint64_t &word : words) {
+    word = random_() & random_();
+  }
+
+  const int flags[] = {
+    MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0,
+    MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0
+        | MARISA2_CACHE_LINE_LAYOUT,
+    MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0 | MARISA2_WIDE_INDEX,
+    0, MARISA2_CACHE_LINE_LAYOUT
+  };
+  for (int flag : flags) {
+    marisa2::Error error;
+    marisa2::grimoire::BitVector bit_vector;
+    error = bit_vector.push_back_words(words.data(), words.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.push_back_bits(random_(), 33);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.build(flag);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+    std::stringstream stream;
+    marisa2::grimoire::Writer writer;
+    error = writer.open(stream);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.write(writer);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = writer.flush();
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    const std::string image = stream.str();
+
+    marisa2::grimoire::BitVector mapped;
+    marisa2::grimoire::Mapper mapper;
+    error = mapper.open(image.data(), image.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = mapped.map(mapper, bit_vector.header());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+    ASSERT_EQ(bit_vector.size(), mapped.size());
+    ASSERT_EQ(bit_vector.num_1s(), mapped.num_1s());
+    ASSERT_EQ(bit_vector.flags(), mapped.flags());
+    for (std::size_t i = 0; i < bit_vector.size(); i += 97) {
+      ASSERT_EQ(bit_vector[i], mapped[i]) << i;
+      ASSERT_EQ(bit_vector.rank_1(i), mapped.rank_1(i)) << i;
+    }
+
+    // A missing select index is built on the first select_1/0().
+    error = mapped.enable_select(
+        MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0, true);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    ASSERT_EQ(static_cast<std::uint64_t>(bit_vector.flags()),
+              mapped.header().flags);
+
+    std::vector<std::size_t> results[4];
+    std::thread threads[4];
+    for (std::size_t i = 0; i < 4; ++i) {
+      threads[i] = std::thread([&mapped, &results, i] {
+        for (std::size_t j = 0; j < mapped.num_1s(); j += 7) {
+          results[i].push_back(mapped.select_1(j));
+        }
+        for (std::size_t j = 0; j < mapped.num_0s(); j += 7) {
+          results[i].push_back(mapped.select_0(j));
+        }
+      });
+    }
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+    ASSERT_EQ(static_cast<std::uint64_t>(bit_vector.flags()
+        | MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0),
+              mapped.header().flags);
+
+    std::vector<std::size_t> expected;
+    for (std::size_t i = 0; i < bit_vector.size(); ++i) {
+      if (bit_vector[i]) {
+        if ((bit_vector.rank_1(i) % 7) == 0) {
+          expected.push_back(i);
+        }
+      }
+    }
+    for (std::size_t i = 0; i < bit_vector.size(); ++i) {
+      if (!bit_vector[i]) {
+        if ((bit_vector.rank_0(i) % 7) == 0) {
+          expected.push_back(i);
+        }
+      }
+    }
+    for (const std::vector<std::size_t> &result : results) {
+      ASSERT_TRUE(result == expected) << flag;
+    }
+  }
+
+  {
+    marisa2::Error error;
+    marisa2::grimoire::BitVector bit_vector;
+    marisa2::grimoire::Mapper mapper;
+    error = bit_vector.enable_select(MARISA2_ENABLE_SELECT_1);
+    ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+    error = bit_vector.map(mapper, marisa2::grimoire::BitVectorHeader{
+        1, 2, MARISA2_ENABLE_RANK });
+    ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+    error = bit_vector.map(mapper, marisa2::grimoire::BitVectorHeader{
+        1, 1, 0 });
+    ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+    error = bit_vector.map(mapper, marisa2::grimoire::BitVectorHeader{
+        std::uint64_t(1) << 40, 1, MARISA2_ENABLE_RANK });
+    ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+  }
+}
+
+TEST_F(BitVectorTest, MapAlignment) {
+  marisa2::Error error;
+  marisa2::grimoire::BitVector bit_vector;
+  for (std::size_t i = 0; i < NUM_BITS; ++i) {
+    error = bit_vector.push_back((random_() % 3) == 0);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  }
+  error = bit_vector.build(MARISA2_CACHE_LINE_LAYOUT);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  ASSERT_TRUE(bit_vector.is_aligned());
+
+  std::stringstream stream;
+  marisa2::grimoire::Writer writer;
+  error = writer.open(stream);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  error = bit_vector.write(writer);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  error = writer.flush();
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  const std::string image = stream.str();
+
+  // The image is mapped at every 8-byte offset from a cache line. The lines
+  // are used in place, and they are aligned only at offset 0.
+  std::vector<std::uint64_t> buf((image.size() / 8) + 16);
+  char *aligned = reinterpret_cast<char *>(buf.data());
+  aligned += (64 - (reinterpret_cast<std::uintptr_t>(aligned) % 64)) % 64;
+  for (std::size_t offset = 0; offset < 64; offset += 8) {
+    std::copy(image.begin(), image.end(), aligned + offset);
+
+    marisa2::grimoire::BitVector mapped;
+    marisa2::grimoire::Mapper mapper;
+    error = mapper.open(aligned + offset, image.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = mapped.map(mapper, bit_vector.header());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    ASSERT_TRUE(mapped.is_mapped());
+    ASSERT_EQ(offset == 0, mapped.is_aligned()) << offset;
+    for (std::size_t i = 0; i < bit_vector.size(); i += 97) {
+      ASSERT_EQ(bit_vector[i], mapped[i]) << i;
+      ASSERT_EQ(bit_vector.rank_1(i), mapped.rank_1(i)) << i;
+    }
+  }
 }
 
 TEST_F(BitVectorTest, Read) {
-  // TODO
+  const int flags[] = {
+    0, MARISA2_ENABLE_SELECT_1, MARISA2_ENABLE_SELECT_0,
+    MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0
+        | MARISA2_CACHE_LINE_LAYOUT,
+    MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0 | MARISA2_WIDE_INDEX,
+    MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0
+        | MARISA2_SELECT_INTERVAL_8192
+  };
+  for (int flag : flags) {
+    marisa2::Error error;
+    marisa2::grimoire::BitVector bit_vector;
+    for (std::size_t i = 0; i < (NUM_BITS / 64); ++i) {
+      error = bit_vector.push_back_word(random_() | random_());
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    }
+    error = bit_vector.push_back_bits(random_(), 17);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.build(flag);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+    std::stringstream stream;
+    marisa2::grimoire::Writer writer;
+    error = writer.open(stream);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.write(writer);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = writer.flush();
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    const std::string image = stream.str();
+
+    {
+      marisa2::grimoire::BitVector bit_vector2;
+      marisa2::grimoire::Reader reader;
+      error = reader.open(stream);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      error = bit_vector2.read(reader, bit_vector.header());
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+      ASSERT_EQ(bit_vector.size(), bit_vector2.size());
+      ASSERT_EQ(bit_vector.num_1s(), bit_vector2.num_1s());
+      ASSERT_EQ(bit_vector.flags(), bit_vector2.flags());
+      std::size_t num_1s = 0;
+      for (std::size_t i = 0; i < bit_vector.size(); ++i) {
+        ASSERT_EQ(bit_vector[i], bit_vector2[i]) << i;
+        ASSERT_EQ(num_1s, bit_vector2.rank_1(i)) << i;
+        if (bit_vector[i]) {
+          if (flag & MARISA2_ENABLE_SELECT_1) {
+            ASSERT_EQ(i, bit_vector2.select_1(num_1s)) << i;
+          }
+          ++num_1s;
+        } else if (flag & MARISA2_ENABLE_SELECT_0) {
+          ASSERT_EQ(i, bit_vector2.select_0(i - num_1s)) << i;
+        }
+      }
+    }
+
+    // A header that does not match the image is rejected, and the bit
+    // vector is not modified.
+    {
+      marisa2::grimoire::BitVector bit_vector2;
+      marisa2::grimoire::BitVectorHeader header = bit_vector.header();
+      --header.num_1s;
+      std::stringstream stream2(image);
+      marisa2::grimoire::Reader reader;
+      error = reader.open(stream2);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      error = bit_vector2.read(reader, header);
+      ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+      ASSERT_EQ(0U, bit_vector2.size());
+      ASSERT_EQ(0, bit_vector2.flags());
+
+      marisa2::grimoire::Mapper mapper;
+      error = mapper.open(image.data(), image.size());
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      error = bit_vector2.map(mapper, header);
+      ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+      ASSERT_EQ(0U, bit_vector2.size());
+    }
+
+    // A truncated image fails to be read.
+    {
+      marisa2::grimoire::BitVector bit_vector2;
+      std::stringstream stream2(image.substr(0, image.size() - 1));
+      marisa2::grimoire::Reader reader;
+      error = reader.open(stream2);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      error = bit_vector2.read(reader, bit_vector.header());
+      ASSERT_EQ(MARISA2_IO_ERROR, error.code()) << error.message();
+      ASSERT_EQ(0U, bit_vector2.size());
+    }
+  }
+
+  {
+    marisa2::Error error;
+    marisa2::grimoire::BitVector bit_vector;
+    std::stringstream stream;
+    marisa2::grimoire::Reader reader;
+    error = reader.open(stream);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.read(reader, marisa2::grimoire::BitVectorHeader{
+        1, 2, MARISA2_ENABLE_RANK });
+    ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+    error = bit_vector.read(reader, marisa2::grimoire::BitVectorHeader{
+        1, 1, MARISA2_ENABLE_RANK | (1 << 20) });
+    ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+    error = bit_vector.read(reader, marisa2::grimoire::BitVectorHeader{
+        std::uint64_t(1) << 40, 1, MARISA2_ENABLE_RANK });
+    ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+    error = bit_vector.read(reader, marisa2::grimoire::BitVectorHeader{
+        1, 1, MARISA2_ENABLE_RANK | (9 << 8) });
+    ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+  }
 }
 
 TEST_F(BitVectorTest, Write) {
-  // TODO
+  marisa2::Error error;
+  marisa2::grimoire::BitVector bit_vector;
+
+  std::stringstream stream;
+  marisa2::grimoire::Writer writer;
+  error = writer.open(stream);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+  error = bit_vector.write(writer);
+  ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+
+  for (std::size_t i = 0; i < 1000; ++i) {
+    error = bit_vector.push_back((i % 3) == 0);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  }
+  error = bit_vector.build(MARISA2_ENABLE_SELECT_1);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  error = bit_vector.write(writer);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  error = writer.flush();
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+  // 4 packs of bits and a sentinel pack, followed by 2 select hints and a
+  // sentinel hint.
+  ASSERT_EQ((5U * 40) + (3U * 4), stream.str().size());
 }
 
 TEST_F(BitVectorTest, PushBack) {
@@ -56,6 +357,75 @@ TEST_F(BitVectorTest, PushBack) {
   ASSERT_TRUE(bit_vector[2]);
 }
 
+TEST_F(BitVectorTest, PushBackBits) {
+  marisa2::Error error;
+  marisa2::grimoire::BitVector bit_vector;
+  std::vector<bool> bits;
+
+  error = bit_vector.push_back_bits(0, 65);
+  ASSERT_EQ(MARISA2_RANGE_ERROR, error.code()) << error.message();
+
+  for (std::size_t i = 0; i < (NUM_BITS / 32); ++i) {
+    const std::uint64_t word = random_();
+    const std::size_t num_bits = random_() % 65;
+    error = bit_vector.push_back_bits(word, num_bits);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    for (std::size_t j = 0; j < num_bits; ++j) {
+      bits.push_back((word >> j) & 1);
+    }
+  }
+
+  std::uint64_t words[5];
+  for (std::size_t i = 0; i < 5; ++i) {
+    words[i] = random_();
+  }
+  for (std::size_t i = 0; i <= 5; ++i) {
+    error = bit_vector.push_back_words(words, i);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    for (std::size_t j = 0; j < (i * 64); ++j) {
+      bits.push_back((words[j / 64] >> (j % 64)) & 1);
+    }
+
+    error = bit_vector.push_back_word(words[i % 5]);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    for (std::size_t j = 0; j < 64; ++j) {
+      bits.push_back((words[i % 5] >> j) & 1);
+    }
+
+    error = bit_vector.push_back(true);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    bits.push_back(true);
+  }
+
+  ASSERT_EQ(bits.size(), bit_vector.size());
+  for (std::size_t i = 0; i < bits.size(); ++i) {
+    ASSERT_EQ(bits[i], bit_vector[i]) << i;
+  }
+
+  error = bit_vector.build(MARISA2_ENABLE_SELECT_1);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+  std::size_t num_1s = 0;
+  for (std::size_t i = 0; i < bits.size(); ++i) {
+    ASSERT_EQ(num_1s, bit_vector.rank_1(i));
+    if (bits[i]) {
+      ASSERT_EQ(i, bit_vector.select_1(num_1s));
+      ++num_1s;
+    }
+  }
+  ASSERT_EQ(num_1s, bit_vector.num_1s());
+
+  // Bits can be appended after build().
+  error = bit_vector.push_back_bits(1, 1);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  error = bit_vector.push_back_words(words, 1);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  ASSERT_EQ(bits.size() + 65, bit_vector.size());
+  ASSERT_EQ(num_1s + 1 + marisa2::grimoire::PopCount::pop_count(words[0]),
+            bit_vector.num_1s());
+  ASSERT_EQ(bits.size(), bit_vector.select_1(num_1s));
+}
+
 TEST_F(BitVectorTest, Build) {
   marisa2::Error error;
   marisa2::grimoire::BitVector bit_vector;
@@ -78,6 +448,356 @@ TEST_F(BitVectorTest, Build) {
   ASSERT_EQ(bit_vector.num_0s(), bit_vector.rank_0(bit_vector.size()));
 }
 
+TEST_F(BitVectorTest, BuildThreads) {
+  // A parallel build must be bit-identical to a sequential build.
+  std::vector<std::uint64_t> words(NUM_BITS * 2);
+  for (std::uint64_t &word : words) {
+    word = random_() & random_();
+  }
+  const std::uint64_t last_bits = random_();
+
+  const int flags[] = {
+    0, MARISA2_CACHE_LINE_LAYOUT, MARISA2_WIDE_INDEX,
+  };
+  for (int flag : flags) {
+    std::string images[2];
+    const std::size_t num_threads[] = { 1, 4 };
+    for (std::size_t i = 0; i < 2; ++i) {
+      marisa2::Error error;
+      marisa2::grimoire::BitVector bit_vector;
+      error = bit_vector.push_back_words(words.data(), words.size());
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      error = bit_vector.push_back_bits(last_bits, 33);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+      error = bit_vector.build(MARISA2_ENABLE_SELECT_1 |
+                               MARISA2_ENABLE_SELECT_0 | flag,
+                               num_threads[i]);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+      std::stringstream stream;
+      marisa2::grimoire::Writer writer;
+      error = writer.open(stream);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      error = bit_vector.write(writer);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      error = writer.flush();
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      images[i] = stream.str();
+    }
+    ASSERT_FALSE(images[0].empty());
+    ASSERT_TRUE(images[0] == images[1]) << flag;
+  }
+}
+
+TEST_F(BitVectorTest, Combine) {
+  const int ops[] = {
+    marisa2::grimoire::BitVector::BITWISE_AND,
+    marisa2::grimoire::BitVector::BITWISE_OR,
+    marisa2::grimoire::BitVector::BITWISE_XOR,
+    marisa2::grimoire::BitVector::BITWISE_ANDNOT
+  };
+  // -1 means that an operand is not built.
+  const int input_flags[] = { -1, 0, MARISA2_CACHE_LINE_LAYOUT };
+  const int output_flags[] = {
+    0, MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0,
+    MARISA2_CACHE_LINE_LAYOUT | MARISA2_ENABLE_SELECT_1, MARISA2_WIDE_INDEX
+  };
+  // The last size is split into chunks by 2 threads.
+  const std::size_t sizes[] = { 0, 1, 255, 256, 1000, (1 << 21) + 17 };
+  for (std::size_t size : sizes) {
+    std::vector<std::uint64_t> lhs_bits((size + 63) / 64);
+    std::vector<std::uint64_t> rhs_bits((size + 63) / 64);
+    for (std::size_t i = 0; i < lhs_bits.size(); ++i) {
+      lhs_bits[i] = random_() & random_();
+      rhs_bits[i] = random_() | random_();
+    }
+    for (int input_flag : input_flags) {
+      marisa2::Error error;
+      marisa2::grimoire::BitVector lhs;
+      marisa2::grimoire::BitVector rhs;
+      for (std::size_t i = 0; i < size; i += 64) {
+        const std::size_t num_bits = std::min<std::size_t>(size - i, 64);
+        error = lhs.push_back_bits(lhs_bits[i / 64], num_bits);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        error = rhs.push_back_bits(rhs_bits[i / 64], num_bits);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      }
+      if (input_flag != -1) {
+        error = lhs.build(input_flag);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        error = rhs.build(input_flag ^ MARISA2_CACHE_LINE_LAYOUT);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      }
+
+      for (int op : ops) {
+        for (int output_flag : output_flags) {
+          // The result must be the same as a bit vector built from the
+          // combined bits.
+          marisa2::grimoire::BitVector expected;
+          for (std::size_t i = 0; i < size; i += 64) {
+            const std::uint64_t x = lhs_bits[i / 64];
+            const std::uint64_t y = rhs_bits[i / 64];
+            const std::uint64_t z =
+                (op == marisa2::grimoire::BitVector::BITWISE_AND) ? (x & y) :
+                (op == marisa2::grimoire::BitVector::BITWISE_OR) ? (x | y) :
+                (op == marisa2::grimoire::BitVector::BITWISE_XOR) ? (x ^ y) :
+                (x & ~y);
+            error = expected.push_back_bits(
+                z, std::min<std::size_t>(size - i, 64));
+            ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+          }
+          error = expected.build(output_flag);
+          ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+          marisa2::grimoire::BitVector bit_vector;
+          error = bit_vector.combine(lhs, rhs, op, output_flag, 2);
+          ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+          ASSERT_EQ(expected.size(), bit_vector.size());
+          ASSERT_EQ(expected.num_1s(), bit_vector.num_1s());
+          ASSERT_EQ(expected.flags(), bit_vector.flags());
+
+          std::stringstream expected_stream;
+          std::stringstream stream;
+          marisa2::grimoire::Writer writer;
+          error = writer.open(expected_stream);
+          ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+          error = expected.write(writer);
+          ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+          error = writer.flush();
+          ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+          error = writer.open(stream);
+          ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+          error = bit_vector.write(writer);
+          ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+          error = writer.flush();
+          ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+          ASSERT_TRUE(expected_stream.str() == stream.str())
+              << size << ' ' << input_flag << ' ' << op << ' ' << output_flag;
+        }
+      }
+    }
+  }
+
+  {
+    marisa2::Error error;
+    marisa2::grimoire::BitVector lhs;
+    marisa2::grimoire::BitVector rhs;
+    marisa2::grimoire::BitVector bit_vector;
+    error = lhs.push_back(true);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+    error = bit_vector.combine(lhs, rhs,
+                               marisa2::grimoire::BitVector::BITWISE_AND);
+    ASSERT_EQ(MARISA2_RANGE_ERROR, error.code()) << error.message();
+    error = rhs.push_back(true);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.combine(lhs, rhs, 4);
+    ASSERT_EQ(MARISA2_CODE_ERROR, error.code()) << error.message();
+    error = bit_vector.combine(lhs, rhs,
+                               marisa2::grimoire::BitVector::BITWISE_AND);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    ASSERT_EQ(1U, bit_vector.num_1s());
+    error = bit_vector.combine(lhs, rhs,
+                               marisa2::grimoire::BitVector::BITWISE_AND);
+    ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+  }
+}
+
+TEST_F(BitVectorTest, Append) {
+  // image() writes a bit vector into a string.
+  auto image = [](marisa2::grimoire::BitVector &bit_vector,
+                  std::string *str) {
+    std::stringstream stream;
+    marisa2::grimoire::Writer writer;
+    marisa2::Error error = writer.open(stream);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.write(writer);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = writer.flush();
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    *str = stream.str();
+  };
+
+  // The bit vector extended after build() must be the same as the one built
+  // from all the bits.
+  const int flags[] = {
+    0, MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0,
+    MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0
+        | MARISA2_CACHE_LINE_LAYOUT,
+    MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0 | MARISA2_WIDE_INDEX,
+    MARISA2_ENABLE_SELECT_0 | MARISA2_SELECT_INTERVAL_64
+  };
+  const std::size_t initial_sizes[] = { 0, 1, 256, 1000 };
+  for (int flag : flags) {
+    for (std::size_t initial_size : initial_sizes) {
+      marisa2::Error error;
+      std::vector<bool> bits;
+      marisa2::grimoire::BitVector bit_vector;
+      for (std::size_t i = 0; i < initial_size; ++i) {
+        bits.push_back((random_() % 3) == 0);
+        error = bit_vector.push_back(bits.back());
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      }
+      error = bit_vector.build(flag);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+      for (std::size_t round = 0; round < 50; ++round) {
+        // Dense and sparse bits are appended by each function.
+        const std::uint64_t mask = ((round % 3) == 0) ? ~std::uint64_t(0) :
+            ((round % 3) == 1) ? (random_() & random_() & random_()) :
+            (random_() | random_() | random_());
+        std::uint64_t words[3];
+        for (std::uint64_t &word : words) {
+          word = random_() & mask;
+        }
+        const std::size_t num_bits = random_() % 65;
+        const std::size_t num_words = random_() % 4;
+        error = bit_vector.push_back((words[0] & 1) != 0);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        bits.push_back((words[0] & 1) != 0);
+        error = bit_vector.push_back_bits(words[1], num_bits);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        for (std::size_t i = 0; i < num_bits; ++i) {
+          bits.push_back((words[1] >> i) & 1);
+        }
+        error = bit_vector.push_back_words(words, num_words);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        for (std::size_t i = 0; i < (num_words * 64); ++i) {
+          bits.push_back((words[i / 64] >> (i % 64)) & 1);
+        }
+        ASSERT_EQ(bits.size(), bit_vector.size());
+
+        marisa2::grimoire::BitVector expected;
+        for (bool bit : bits) {
+          error = expected.push_back(bit);
+          ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        }
+        error = expected.build(flag);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        ASSERT_EQ(expected.num_1s(), bit_vector.num_1s());
+        ASSERT_EQ(expected.flags(), bit_vector.flags());
+
+        std::string expected_image;
+        std::string bit_vector_image;
+        image(expected, &expected_image);
+        image(bit_vector, &bit_vector_image);
+        ASSERT_TRUE(expected_image == bit_vector_image)
+            << flag << ' ' << initial_size << ' ' << round;
+      }
+    }
+  }
+
+  // Appended bits cross a group of packs in the wide index mode.
+  {
+    constexpr std::size_t GROUP_SIZE = std::size_t(256) << 16;
+
+    marisa2::Error error;
+    marisa2::grimoire::BitVector bit_vector;
+    marisa2::grimoire::BitVector expected;
+    for (std::size_t i = 0; i < ((GROUP_SIZE / 64) - 10); ++i) {
+      const std::uint64_t word = random_();
+      error = bit_vector.push_back_word(word);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      error = expected.push_back_word(word);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    }
+    error = bit_vector.build(MARISA2_WIDE_INDEX | MARISA2_ENABLE_SELECT_1);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    for (std::size_t i = 0; i < 100; ++i) {
+      const std::uint64_t word = random_();
+      error = bit_vector.push_back_bits(word, 37);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      error = expected.push_back_bits(word, 37);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    }
+    error = expected.build(MARISA2_WIDE_INDEX | MARISA2_ENABLE_SELECT_1);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+    std::string expected_image;
+    std::string bit_vector_image;
+    image(expected, &expected_image);
+    image(bit_vector, &bit_vector_image);
+    ASSERT_TRUE(expected_image == bit_vector_image);
+  }
+
+  // A lazy select index is built from the appended bits.
+  {
+    marisa2::Error error;
+    marisa2::grimoire::BitVector bit_vector;
+    error = bit_vector.push_back_bits(0x0F, 8);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.build();
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.enable_select(MARISA2_ENABLE_SELECT_1, true);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    for (std::size_t i = 0; i < 1000; ++i) {
+      error = bit_vector.push_back_bits(0x0F, 8);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    }
+    for (std::size_t i = 0; i < bit_vector.num_1s(); ++i) {
+      ASSERT_EQ(((i / 4) * 8) + (i % 4), bit_vector.select_1(i)) << i;
+    }
+    error = bit_vector.push_back(true);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    ASSERT_EQ(bit_vector.size() - 1,
+              bit_vector.select_1(bit_vector.num_1s() - 1));
+  }
+
+  // A mapped bit vector cannot be extended.
+  {
+    marisa2::Error error;
+    marisa2::grimoire::BitVector bit_vector;
+    error = bit_vector.push_back_bits(random_(), 64);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.build(MARISA2_ENABLE_SELECT_1);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    std::string str;
+    image(bit_vector, &str);
+
+    marisa2::grimoire::BitVector mapped;
+    marisa2::grimoire::Mapper mapper;
+    error = mapper.open(str.data(), str.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = mapped.map(mapper, bit_vector.header());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = mapped.push_back(true);
+    ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+    error = mapped.push_back_bits(1, 1);
+    ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+    ASSERT_EQ(64U, mapped.size());
+  }
+
+  // Neither can a mapped cache-line layout at any offset of the image, even
+  // if it has no select hints.
+  for (int flags : { 0, int(MARISA2_ENABLE_SELECT_1) }) {
+    for (std::size_t offset : { 0, 8 }) {
+      marisa2::Error error;
+      marisa2::grimoire::BitVector bit_vector;
+      for (std::size_t i = 0; i < 100; ++i) {
+        error = bit_vector.push_back_bits(random_(), 64);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      }
+      error = bit_vector.build(flags | MARISA2_CACHE_LINE_LAYOUT);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      std::string str;
+      image(bit_vector, &str);
+      str.insert(0, offset, '\0');
+
+      marisa2::grimoire::BitVector mapped;
+      marisa2::grimoire::Mapper mapper;
+      error = mapper.open(str.data() + offset, str.size() - offset);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      error = mapped.map(mapper, bit_vector.header());
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      error = mapped.push_back_bits(3, 2);
+      ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+      ASSERT_EQ(6400U, mapped.size());
+      ASSERT_EQ(bit_vector.rank_1(6400), mapped.rank_1(6400));
+    }
+  }
+}
+
 TEST_F(BitVectorTest, Rank) {
   marisa2::Error error;
   marisa2::grimoire::BitVector bit_vector;
@@ -104,6 +824,368 @@ TEST_F(BitVectorTest, Rank) {
   ASSERT_EQ(1U, bit_vector.rank_0(3));
 }
 
+TEST_F(BitVectorTest, CacheLineLayout) {
+  marisa2::Error error;
+  marisa2::grimoire::BitVector bit_vector;
+  std::vector<bool> bits;
+
+  // A large vector is used to test multiple groups of lines.
+  for (std::size_t i = 0; i < (NUM_BITS * 4); ++i) {
+    const bool bit = (random_() % 3) == 0;
+    error = bit_vector.push_back(bit);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    bits.push_back(bit);
+  }
+
+  error = bit_vector.build(MARISA2_CACHE_LINE_LAYOUT);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  ASSERT_EQ(MARISA2_ENABLE_RANK | MARISA2_CACHE_LINE_LAYOUT,
+            bit_vector.flags());
+
+  std::size_t num_1s = 0;
+  for (std::size_t i = 0; i < bits.size(); ++i) {
+    ASSERT_EQ(bits[i], bit_vector[i]);
+    ASSERT_EQ(num_1s, bit_vector.rank_1(i));
+    num_1s += bits[i];
+  }
+  ASSERT_EQ(num_1s, bit_vector.num_1s());
+  ASSERT_EQ(num_1s, bit_vector.rank_1(bit_vector.size()));
+}
+
+TEST_F(BitVectorTest, WideIndex) {
+  // The wide index mode is forced on a vector that has 3 groups of packs.
+  const std::size_t num_words = (std::size_t(1) << 19) + 12345;
+  std::vector<std::uint64_t> words;
+  for (std::size_t i = 0; i < num_words; ++i) {
+    // The first half is dense and the latter half is sparse.
+    words.push_back((i < (num_words / 2)) ? ~(random_() & random_())
+                                          : (random_() & random_()));
+  }
+
+  for (int layout : LAYOUTS) {
+    marisa2::Error error;
+    marisa2::grimoire::BitVector bit_vector;
+    error = bit_vector.push_back_words(words.data(), words.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.push_back_bits(5, 3);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+    error = bit_vector.build(MARISA2_ENABLE_SELECT_1 |
+                             MARISA2_ENABLE_SELECT_0 |
+                             MARISA2_WIDE_INDEX | layout);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    ASSERT_EQ(MARISA2_ENABLE_RANK | MARISA2_ENABLE_SELECT_1 |
+              MARISA2_ENABLE_SELECT_0 | MARISA2_WIDE_INDEX | layout,
+              bit_vector.flags());
+    ASSERT_EQ(static_cast<std::uint64_t>(bit_vector.flags()),
+              bit_vector.header().flags);
+
+    std::size_t num_1s = 0;
+    for (std::size_t i = 0; i < bit_vector.size(); ++i) {
+      const bool bit = (i < (num_words * 64)) ?
+          ((words[i / 64] >> (i % 64)) & 1) : ((5 >> (i % 64)) & 1);
+      if ((i % 61) == 0) {
+        ASSERT_EQ(num_1s, bit_vector.rank_1(i)) << i;
+      }
+      if ((i % 67) == 0) {
+        if (bit) {
+          ASSERT_EQ(i, bit_vector.select_1(num_1s)) << i;
+        } else {
+          ASSERT_EQ(i, bit_vector.select_0(i - num_1s)) << i;
+        }
+      }
+      num_1s += bit;
+    }
+    ASSERT_EQ(num_1s, bit_vector.num_1s());
+    ASSERT_EQ(num_1s, bit_vector.rank_1(bit_vector.size()));
+  }
+}
+
+TEST_F(BitVectorTest, RankBatch) {
+  for (int layout : LAYOUTS) {
+    marisa2::Error error;
+    marisa2::grimoire::BitVector bit_vector;
+    for (std::size_t i = 0; i < (NUM_BITS / 64); ++i) {
+      error = bit_vector.push_back_word(random_());
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    }
+    error = bit_vector.build(layout);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+    std::vector<std::size_t> pos;
+    for (std::size_t i = 0; i < 1000; ++i) {
+      pos.push_back(random_() % (bit_vector.size() + 1));
+    }
+
+    // Batches shorter than the prefetch distance are also tested.
+    for (std::size_t n : { std::size_t(0), std::size_t(1), std::size_t(7),
+                           pos.size() }) {
+      std::vector<std::size_t> out(n + 1, 12345);
+      bit_vector.rank_1_batch(pos.data(), out.data(), n);
+      for (std::size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(bit_vector.rank_1(pos[i]), out[i]);
+      }
+      ASSERT_EQ(12345U, out[n]);
+
+      bit_vector.rank_0_batch(pos.data(), out.data(), n);
+      for (std::size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(bit_vector.rank_0(pos[i]), out[i]);
+      }
+      ASSERT_EQ(12345U, out[n]);
+    }
+  }
+}
+
+TEST_F(BitVectorTest, SelectBatch) {
+  const int modes[] = { 0, MARISA2_CACHE_LINE_LAYOUT, MARISA2_WIDE_INDEX };
+  for (int mode : modes) {
+    marisa2::Error error;
+    marisa2::grimoire::BitVector bit_vector;
+    for (std::size_t i = 0; i < (NUM_BITS / 64); ++i) {
+      // Sparse ranges are inserted to test the binary search.
+      const bool is_sparse = (i / 256) % 3 == 0;
+      error = bit_vector.push_back_word(
+          is_sparse ? (random_() & random_() & random_() & random_() &
+                       random_() & random_()) : random_());
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    }
+    error = bit_vector.build(MARISA2_ENABLE_SELECT_1 |
+                             MARISA2_ENABLE_SELECT_0 | mode);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+    std::vector<std::size_t> ranks_1;
+    std::vector<std::size_t> ranks_0;
+    for (std::size_t i = 0; i < 1000; ++i) {
+      ranks_1.push_back(random_() % bit_vector.num_1s());
+      ranks_0.push_back(random_() % bit_vector.num_0s());
+    }
+
+    for (std::size_t n : { std::size_t(0), std::size_t(1), std::size_t(5),
+                           ranks_1.size() }) {
+      std::vector<std::size_t> out(n + 1, 12345);
+      bit_vector.select_1_batch(ranks_1.data(), out.data(), n);
+      for (std::size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(bit_vector.select_1(ranks_1[i]), out[i]);
+      }
+      ASSERT_EQ(12345U, out[n]);
+
+      bit_vector.select_0_batch(ranks_0.data(), out.data(), n);
+      for (std::size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(bit_vector.select_0(ranks_0[i]), out[i]);
+      }
+      ASSERT_EQ(12345U, out[n]);
+    }
+  }
+}
+
+TEST_F(BitVectorTest, GetBits) {
+  for (int layout : LAYOUTS) {
+    marisa2::Error error;
+    marisa2::grimoire::BitVector bit_vector;
+    std::vector<bool> bits;
+
+    for (std::size_t i = 0; i < (NUM_BITS / 64); ++i) {
+      const std::uint64_t word = random_();
+      error = bit_vector.push_back_word(word);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      for (std::size_t j = 0; j < 64; ++j) {
+        bits.push_back((word >> j) & 1);
+      }
+    }
+
+    error = bit_vector.build(layout);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+    std::vector<std::size_t> ranks(bits.size() + 1, 0);
+    for (std::size_t i = 0; i < bits.size(); ++i) {
+      ranks[i + 1] = ranks[i] + bits[i];
+    }
+
+    for (std::size_t i = 0; i < 10000; ++i) {
+      const std::size_t len = random_() % 65;
+      const std::size_t pos = random_() % (bits.size() - len + 1);
+      std::uint64_t expected = 0;
+      for (std::size_t j = 0; j < len; ++j) {
+        expected |= std::uint64_t(bits[pos + j]) << j;
+      }
+      ASSERT_EQ(expected, bit_vector.get_bits(pos, len)) << pos << ' ' << len;
+
+      const std::size_t end = pos + (random_() % ((i % 2) ? 1000 : 65));
+      if (end <= bits.size()) {
+        ASSERT_EQ(ranks[end] - ranks[pos], bit_vector.count_1(pos, end));
+        ASSERT_EQ((end - pos) - (ranks[end] - ranks[pos]),
+                  bit_vector.count_0(pos, end));
+      }
+    }
+    ASSERT_EQ(0U, bit_vector.get_bits(bits.size(), 0));
+    ASSERT_EQ(ranks.back(), bit_vector.count_1(0, bits.size()));
+  }
+}
+
+TEST_F(BitVectorTest, NextPrev) {
+  const double densities[] = { 0.0, 0.001, 0.1, 0.5, 0.9, 0.999, 1.0 };
+  const int selects[] = {
+    0, MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0
+  };
+  for (int layout : LAYOUTS) {
+    for (int select : selects) {
+      for (double density : densities) {
+        marisa2::Error error;
+        marisa2::grimoire::BitVector bit_vector;
+        std::vector<bool> bits;
+
+        std::bernoulli_distribution distribution(density);
+        for (std::size_t i = 0; i < (NUM_BITS / 4) + 5; ++i) {
+          const bool bit = distribution(random_);
+          error = bit_vector.push_back(bit);
+          ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+          bits.push_back(bit);
+        }
+
+        error = bit_vector.build(select | layout);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+        const std::size_t size = bits.size();
+        std::vector<std::size_t> next_1s(size + 1, size);
+        std::vector<std::size_t> next_0s(size + 1, size);
+        for (std::size_t i = size; i > 0; --i) {
+          next_1s[i - 1] = bits[i - 1] ? (i - 1) : next_1s[i];
+          next_0s[i - 1] = bits[i - 1] ? next_0s[i] : (i - 1);
+        }
+        std::size_t prev_1 = size;
+        std::size_t prev_0 = size;
+        for (std::size_t i = 0; i < size; ++i) {
+          (bits[i] ? prev_1 : prev_0) = i;
+          ASSERT_EQ(next_1s[i], bit_vector.next_1(i)) << density << ' ' << i;
+          ASSERT_EQ(next_0s[i], bit_vector.next_0(i)) << density << ' ' << i;
+          ASSERT_EQ(prev_1, bit_vector.prev_1(i)) << density << ' ' << i;
+          ASSERT_EQ(prev_0, bit_vector.prev_0(i)) << density << ' ' << i;
+        }
+        ASSERT_EQ(size, bit_vector.next_1(size));
+        ASSERT_EQ(size, bit_vector.next_0(size));
+        ASSERT_EQ(prev_1, bit_vector.prev_1(size));
+        ASSERT_EQ(prev_0, bit_vector.prev_0(size));
+      }
+    }
+  }
+}
+
+TEST_F(BitVectorTest, NextPrevLongGap) {
+  // A long gap is skipped by rank_1/0() and select_1/0() even if the select
+  // hints are not built or lazy.
+  constexpr std::size_t GAP = std::size_t(1) << 22;
+  const int selects[] = { 0, -1 };
+  for (int layout : LAYOUTS) {
+    for (int select : selects) {
+      marisa2::Error error;
+      marisa2::grimoire::BitVector bit_vector;
+      error = bit_vector.push_back_bits(0x05, 3);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      for (std::size_t i = 0; i < (GAP / 64); ++i) {
+        error = bit_vector.push_back_word(0);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      }
+      error = bit_vector.push_back_bits(0x05, 3);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      for (std::size_t i = 0; i < (GAP / 64); ++i) {
+        error = bit_vector.push_back_word(~std::uint64_t(0));
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      }
+      error = bit_vector.push_back_bits(0x02, 3);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+      error = bit_vector.build(layout);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      if (select == -1) {
+        error = bit_vector.enable_select(
+            MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0, true);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      }
+
+      const std::size_t size = bit_vector.size();
+      ASSERT_EQ(GAP + 3, bit_vector.next_1(3));
+      ASSERT_EQ(2U, bit_vector.prev_1(GAP + 2));
+      ASSERT_EQ((GAP * 2) + 6, bit_vector.next_0(GAP + 6));
+      ASSERT_EQ(GAP + 4, bit_vector.prev_0((GAP * 2) + 5));
+      ASSERT_EQ(size, bit_vector.next_1(size - 1));
+      ASSERT_EQ(size - 2, bit_vector.prev_1(size));
+
+      // The lazy select indices are built by the queries above.
+      if (select == -1) {
+        ASSERT_EQ(MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0,
+                  static_cast<int>(bit_vector.header().flags)
+                  & (MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0));
+      }
+    }
+  }
+}
+
+TEST_F(BitVectorTest, ForEach) {
+  const double densities[] = { 0.0, 0.01, 0.5, 0.99, 1.0 };
+  for (int layout : LAYOUTS) {
+    for (double density : densities) {
+      marisa2::Error error;
+      marisa2::grimoire::BitVector bit_vector;
+      std::vector<bool> bits;
+
+      std::bernoulli_distribution distribution(density);
+      for (std::size_t i = 0; i < (NUM_BITS / 16) + 5; ++i) {
+        const bool bit = distribution(random_);
+        error = bit_vector.push_back(bit);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        bits.push_back(bit);
+      }
+
+      // for_each_1/0() are checked before and after build().
+      for (int built = 0; built < 2; ++built) {
+        if (built) {
+          error = bit_vector.build(layout);
+          ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        }
+
+        std::vector<std::size_t> ones;
+        std::vector<std::size_t> zeros;
+        bit_vector.for_each_1([&ones](std::size_t pos) {
+          ones.push_back(pos);
+        });
+        bit_vector.for_each_0([&zeros](std::size_t pos) {
+          zeros.push_back(pos);
+        });
+        ASSERT_EQ(bits.size(), ones.size() + zeros.size());
+        for (std::size_t pos : ones) {
+          ASSERT_TRUE(bits[pos]) << pos;
+        }
+        for (std::size_t pos : zeros) {
+          ASSERT_FALSE(bits[pos]) << pos;
+        }
+        ASSERT_TRUE(std::is_sorted(ones.begin(), ones.end()));
+        ASSERT_TRUE(std::is_sorted(zeros.begin(), zeros.end()));
+
+        for (std::size_t i = 0; i < 100; ++i) {
+          std::size_t begin = random_() % (bits.size() + 1);
+          std::size_t end = (i < 10) ? begin :
+              (begin + (random_() % (bits.size() - begin + 1)));
+          std::vector<std::size_t> expected_1s;
+          std::vector<std::size_t> expected_0s;
+          for (std::size_t j = begin; j < end; ++j) {
+            (bits[j] ? expected_1s : expected_0s).push_back(j);
+          }
+          ones.clear();
+          zeros.clear();
+          bit_vector.for_each_1(begin, end, [&ones](std::size_t pos) {
+            ones.push_back(pos);
+          });
+          bit_vector.for_each_0(begin, end, [&zeros](std::size_t pos) {
+            zeros.push_back(pos);
+          });
+          ASSERT_TRUE(ones == expected_1s) << begin << ' ' << end;
+          ASSERT_TRUE(zeros == expected_0s) << begin << ' ' << end;
+        }
+      }
+    }
+  }
+}
+
 TEST_F(BitVectorTest, Select) {
   marisa2::Error error;
   marisa2::grimoire::BitVector bit_vector;
@@ -120,5 +1202,153 @@ TEST_F(BitVectorTest, Select) {
   ASSERT_EQ(MARISA2_ENABLE_RANK | MARISA2_ENABLE_SELECT_1 |
             MARISA2_ENABLE_SELECT_0, bit_vector.flags());
 
-  // TODO
+  ASSERT_EQ(0U, bit_vector.select_1(0));
+  ASSERT_EQ(2U, bit_vector.select_1(1));
+
+  ASSERT_EQ(1U, bit_vector.select_0(0));
+}
+
+TEST_F(BitVectorTest, SelectRandom) {
+  const double densities[] = { 0.001, 0.01, 0.1, 0.5, 0.9, 0.99, 0.999 };
+  for (int layout : LAYOUTS) {
+    for (double density : densities) {
+      marisa2::Error error;
+      marisa2::grimoire::BitVector bit_vector;
+      std::vector<std::size_t> ones;
+      std::vector<std::size_t> zeros;
+
+      std::bernoulli_distribution distribution(density);
+      for (std::size_t i = 0; i < NUM_BITS; ++i) {
+        const bool bit = distribution(random_);
+        error = bit_vector.push_back(bit);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        (bit ? ones : zeros).push_back(i);
+      }
+
+      error = bit_vector.build(MARISA2_ENABLE_SELECT_1 |
+                               MARISA2_ENABLE_SELECT_0 | layout);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      ASSERT_EQ(layout, bit_vector.flags() & MARISA2_CACHE_LINE_LAYOUT);
+      ASSERT_EQ(ones.size(), bit_vector.num_1s());
+      ASSERT_EQ(zeros.size(), bit_vector.num_0s());
+
+      for (std::size_t i = 0; i < ones.size(); ++i) {
+        ASSERT_EQ(ones[i], bit_vector.select_1(i)) << density;
+        ASSERT_EQ(i, bit_vector.rank_1(ones[i])) << density;
+      }
+      for (std::size_t i = 0; i < zeros.size(); ++i) {
+        ASSERT_EQ(zeros[i], bit_vector.select_0(i)) << density;
+        ASSERT_EQ(i, bit_vector.rank_0(zeros[i])) << density;
+      }
+    }
+  }
+}
+
+TEST_F(BitVectorTest, SelectUniform) {
+  const std::size_t sizes[] = { 1, 63, 64, 65, 255, 256, 257, 447, 448, 449,
+                                1023, 1024 };
+  for (int layout : LAYOUTS) {
+    for (std::size_t size : sizes) {
+      for (int bit = 0; bit < 2; ++bit) {
+        marisa2::Error error;
+        marisa2::grimoire::BitVector bit_vector;
+        for (std::size_t i = 0; i < size; ++i) {
+          error = bit_vector.push_back(bit != 0);
+          ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        }
+
+        error = bit_vector.build(MARISA2_ENABLE_SELECT_1 |
+                                 MARISA2_ENABLE_SELECT_0 | layout);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        ASSERT_EQ(bit ? size : 0, bit_vector.num_1s());
+
+        for (std::size_t i = 0; i < size; ++i) {
+          if (bit) {
+            ASSERT_EQ(i, bit_vector.select_1(i));
+          } else {
+            ASSERT_EQ(i, bit_vector.select_0(i));
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_F(BitVectorTest, SelectInterval) {
+  const int intervals[] = {
+    MARISA2_SELECT_INTERVAL_64, MARISA2_SELECT_INTERVAL_128,
+    MARISA2_SELECT_INTERVAL_256, MARISA2_SELECT_INTERVAL_512,
+    MARISA2_SELECT_INTERVAL_1024, MARISA2_SELECT_INTERVAL_2048,
+    MARISA2_SELECT_INTERVAL_4096, MARISA2_SELECT_INTERVAL_8192
+  };
+  const double densities[] = { 0.01, 0.5, 0.99 };
+  for (int layout : LAYOUTS) {
+    for (int interval : intervals) {
+      for (double density : densities) {
+        marisa2::Error error;
+        marisa2::grimoire::BitVector bit_vector;
+        std::vector<std::size_t> ones;
+        std::vector<std::size_t> zeros;
+
+        std::bernoulli_distribution distribution(density);
+        for (std::size_t i = 0; i < NUM_BITS; ++i) {
+          const bool bit = distribution(random_);
+          error = bit_vector.push_back(bit);
+          ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+          (bit ? ones : zeros).push_back(i);
+        }
+
+        error = bit_vector.build(MARISA2_ENABLE_SELECT_1 |
+                                 MARISA2_ENABLE_SELECT_0 | layout | interval);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        ASSERT_EQ(interval, bit_vector.flags() & MARISA2_SELECT_INTERVAL_MASK);
+
+        for (std::size_t i = 0; i < ones.size(); ++i) {
+          ASSERT_EQ(ones[i], bit_vector.select_1(i)) << interval;
+        }
+        for (std::size_t i = 0; i < zeros.size(); ++i) {
+          ASSERT_EQ(zeros[i], bit_vector.select_0(i)) << interval;
+        }
+
+        // select_1_batch() uses the same hints.
+        std::vector<std::size_t> ranks(ones.size());
+        for (std::size_t i = 0; i < ranks.size(); ++i) {
+          ranks[i] = i;
+        }
+        std::vector<std::size_t> out(ones.size());
+        bit_vector.select_1_batch(ranks.data(), out.data(), ranks.size());
+        ASSERT_TRUE(out == ones) << interval;
+      }
+    }
+  }
+
+  // Lazy hints use the interval given to build().
+  {
+    marisa2::Error error;
+    marisa2::grimoire::BitVector bit_vector;
+    for (std::size_t i = 0; i < (NUM_BITS / 64); ++i) {
+      error = bit_vector.push_back_word(random_());
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    }
+    error = bit_vector.build(MARISA2_SELECT_INTERVAL_64);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.enable_select(MARISA2_ENABLE_SELECT_1, true);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    std::size_t num_1s = 0;
+    for (std::size_t i = 0; i < bit_vector.size(); ++i) {
+      if (bit_vector[i]) {
+        ASSERT_EQ(i, bit_vector.select_1(num_1s++)) << i;
+      }
+    }
+  }
+
+  {
+    marisa2::Error error;
+    marisa2::grimoire::BitVector bit_vector;
+    error = bit_vector.push_back(true);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.build(9 << 8);
+    ASSERT_EQ(MARISA2_RANGE_ERROR, error.code()) << error.message();
+    ASSERT_EQ(0, bit_vector.flags());
+  }
 }
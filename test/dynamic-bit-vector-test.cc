@@ -0,0 +1,156 @@
+#include "gtest/gtest.h"
+#include "bit-vector-check.h"
+
+#include <random>
+#include <vector>
+
+#include <marisa2/grimoire/dynamic-bit-vector.h>
+
+class DynamicBitVectorTest : public testing::Test {
+ protected:
+  // This function is called before each test.
+  virtual void SetUp() {
+  }
+
+  // This function is called after each test.
+  virtual void TearDown() {
+  }
+
+  static std::mt19937_64 random_;
+};
+
+std::mt19937_64 DynamicBitVectorTest::random_;
+
+TEST_F(DynamicBitVectorTest, DefaultConstructor) {
+  marisa2::grimoire::DynamicBitVector bit_vector;
+
+  ASSERT_FALSE(static_cast<bool>(bit_vector));
+  ASSERT_EQ(0U, bit_vector.size());
+  ASSERT_EQ(0U, bit_vector.num_1s());
+  ASSERT_EQ(0U, bit_vector.height());
+  ASSERT_EQ(0U, bit_vector.rank_1(0));
+}
+
+TEST_F(DynamicBitVectorTest, Error) {
+  marisa2::grimoire::DynamicBitVector bit_vector;
+
+  marisa2::Error error = bit_vector.insert(1, true);
+  ASSERT_EQ(MARISA2_BOUND_ERROR, error.code()) << error.message();
+  error = bit_vector.erase(0);
+  ASSERT_EQ(MARISA2_BOUND_ERROR, error.code()) << error.message();
+  error = bit_vector.set(0, true);
+  ASSERT_EQ(MARISA2_BOUND_ERROR, error.code()) << error.message();
+
+  error = bit_vector.insert(0, true);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  error = bit_vector.erase(1);
+  ASSERT_EQ(MARISA2_BOUND_ERROR, error.code()) << error.message();
+  error = bit_vector.erase(0);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  ASSERT_EQ(0U, bit_vector.size());
+}
+
+TEST_F(DynamicBitVectorTest, PushBack) {
+  constexpr std::size_t NUM_BITS = 200000;
+
+  std::vector<bool> bits;
+  marisa2::grimoire::DynamicBitVector bit_vector;
+  for (std::size_t i = 0; i < NUM_BITS; ++i) {
+    const bool bit = (random_() % 3) == 0;
+    bits.push_back(bit);
+    marisa2::Error error = bit_vector.push_back(bit);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  }
+  // 200000 bits need at least 391 leaves, and each level has at most 16
+  // children per node.
+  ASSERT_GE(bit_vector.height(), 3U);
+  ASSERT_LE(bit_vector.height(), 5U);
+  CheckBitVector(bit_vector, bits);
+
+  bit_vector.clear();
+  ASSERT_EQ(0U, bit_vector.size());
+  ASSERT_EQ(0U, bit_vector.height());
+}
+
+TEST_F(DynamicBitVectorTest, Random) {
+  constexpr std::size_t NUM_OPS = 100000;
+
+  std::vector<bool> bits;
+  marisa2::grimoire::DynamicBitVector bit_vector;
+  for (std::size_t k = 0; k < NUM_OPS; ++k) {
+    // Inserts are more frequent than erases in the first half, and vice
+    // versa in the second half, so that the tree grows and then shrinks.
+    const std::size_t op = random_() % 8;
+    const bool grows = k < (NUM_OPS / 2);
+    if (bits.empty() || (op < (grows ? 5U : 2U))) {
+      const std::size_t i = random_() % (bits.size() + 1);
+      const bool bit = (random_() % 2) != 0;
+      bits.insert(bits.begin() + i, bit);
+      marisa2::Error error = bit_vector.insert(i, bit);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    } else if (op < 7) {
+      const std::size_t i = random_() % bits.size();
+      bits.erase(bits.begin() + i);
+      marisa2::Error error = bit_vector.erase(i);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    } else {
+      const std::size_t i = random_() % bits.size();
+      const bool bit = (random_() % 2) != 0;
+      bits[i] = bit;
+      marisa2::Error error = bit_vector.set(i, bit);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    }
+    ASSERT_EQ(bits.size(), bit_vector.size());
+    if ((k % 10000) == 0) {
+      CheckBitVector(bit_vector, bits);
+    }
+  }
+  CheckBitVector(bit_vector, bits);
+
+  while (!bits.empty()) {
+    const std::size_t i = random_() % bits.size();
+    bits.erase(bits.begin() + i);
+    marisa2::Error error = bit_vector.erase(i);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  }
+  ASSERT_EQ(0U, bit_vector.size());
+  ASSERT_EQ(0U, bit_vector.num_1s());
+  ASSERT_EQ(1U, bit_vector.height());
+}
+
+TEST_F(DynamicBitVectorTest, Freeze) {
+  constexpr std::size_t NUM_BITS = 100000;
+
+  marisa2::grimoire::DynamicBitVector bit_vector;
+  marisa2::grimoire::BitVector frozen;
+  marisa2::Error error = bit_vector.freeze(frozen);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  ASSERT_EQ(0U, frozen.size());
+
+  // The frozen bit vector is compared with bit_vector, whose queries are
+  // validated in the other tests.
+  for (std::size_t i = 0; i < NUM_BITS; ++i) {
+    const std::size_t pos = random_() % (bit_vector.size() + 1);
+    error = bit_vector.insert(pos, (random_() % 2) != 0);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  }
+
+  marisa2::grimoire::BitVector frozen2;
+  error = bit_vector.freeze(frozen2,
+      MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  frozen.swap(frozen2);
+  ASSERT_EQ(bit_vector.size(), frozen.size());
+  ASSERT_EQ(bit_vector.num_1s(), frozen.num_1s());
+  std::size_t num_1s = 0;
+  for (std::size_t i = 0; i < bit_vector.size(); ++i) {
+    ASSERT_EQ(bit_vector[i], frozen[i]) << i;
+    ASSERT_EQ(num_1s, frozen.rank_1(i)) << i;
+    if (bit_vector[i]) {
+      ASSERT_EQ(i, frozen.select_1(num_1s)) << i;
+      ++num_1s;
+    } else {
+      ASSERT_EQ(i, frozen.select_0(i - num_1s)) << i;
+    }
+  }
+}
@@ -0,0 +1,204 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <marisa2/grimoire/elias-fano.h>
+
+class EliasFanoTest : public testing::Test {
+ protected:
+  // This function is called before each test.
+  virtual void SetUp() {
+  }
+
+  // This function is called after each test.
+  virtual void TearDown() {
+  }
+
+  static constexpr std::size_t NUM_VALUES = 1 << 14;
+
+  static std::mt19937_64 random_;
+};
+
+constexpr std::size_t EliasFanoTest::NUM_VALUES;
+std::mt19937_64 EliasFanoTest::random_;
+
+TEST_F(EliasFanoTest, DefaultConstructor) {
+  marisa2::grimoire::EliasFano elias_fano;
+
+  ASSERT_FALSE(static_cast<bool>(elias_fano));
+  ASSERT_EQ(0U, elias_fano.size());
+  ASSERT_EQ(0U, elias_fano.next_geq(0));
+}
+
+TEST_F(EliasFanoTest, Build) {
+  marisa2::Error error;
+  marisa2::grimoire::EliasFano elias_fano;
+
+  const std::uint64_t unsorted[] = { 1, 3, 2 };
+  error = elias_fano.build(unsorted, 3);
+  ASSERT_EQ(MARISA2_RANGE_ERROR, error.code()) << error.message();
+  error = elias_fano.build(nullptr, 3);
+  ASSERT_EQ(MARISA2_NULL_ERROR, error.code()) << error.message();
+
+  const std::uint64_t values[] = { 0, 0, 5, 1000, 1000, 1 << 20 };
+  error = elias_fano.build(values, 6);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  ASSERT_EQ(6U, elias_fano.size());
+  for (std::size_t i = 0; i < 6; ++i) {
+    ASSERT_EQ(values[i], elias_fano[i]);
+  }
+  ASSERT_EQ(0U, elias_fano.next_geq(0));
+  ASSERT_EQ(2U, elias_fano.next_geq(1));
+  ASSERT_EQ(3U, elias_fano.next_geq(6));
+  ASSERT_EQ(5U, elias_fano.next_geq(1001));
+  ASSERT_EQ(6U, elias_fano.next_geq((1 << 20) + 1));
+
+  error = elias_fano.build(values, 6);
+  ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+}
+
+TEST_F(EliasFanoTest, Random) {
+  const std::uint64_t max_gaps[] = {
+    1, 2, 100, 1 << 16, std::uint64_t(1) << 40
+  };
+  for (std::uint64_t max_gap : max_gaps) {
+    std::vector<std::uint64_t> values(NUM_VALUES);
+    std::uint64_t value = random_() % max_gap;
+    for (std::uint64_t &x : values) {
+      x = value;
+      value += random_() % max_gap;
+    }
+
+    marisa2::Error error;
+    marisa2::grimoire::EliasFano elias_fano;
+    error = elias_fano.build(values.data(), values.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    ASSERT_EQ(values.size(), elias_fano.size());
+
+    for (std::size_t i = 0; i < values.size(); ++i) {
+      ASSERT_EQ(values[i], elias_fano.access(i)) << max_gap << ' ' << i;
+      ASSERT_EQ(values[i], elias_fano.select(i)) << max_gap << ' ' << i;
+      ASSERT_EQ(static_cast<std::size_t>(std::lower_bound(
+                    values.begin(), values.end(), values[i]) - values.begin()),
+                elias_fano.next_geq(values[i])) << max_gap << ' ' << i;
+    }
+    for (std::size_t i = 0; i < values.size(); ++i) {
+      const std::uint64_t x = (random_() % (values.back() + 2));
+      const std::size_t expected = static_cast<std::size_t>(
+          std::lower_bound(values.begin(), values.end(), x) - values.begin());
+      ASSERT_EQ(expected, elias_fano.next_geq(x)) << max_gap << ' ' << x;
+      ASSERT_EQ(expected, elias_fano.rank(x)) << max_gap << ' ' << x;
+    }
+  }
+}
+
+TEST_F(EliasFanoTest, Write) {
+  marisa2::Error error;
+  marisa2::grimoire::EliasFano elias_fano;
+
+  std::stringstream stream;
+  marisa2::grimoire::Writer writer;
+  error = writer.open(stream);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  error = elias_fano.write(writer);
+  ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+
+  std::vector<std::uint64_t> values(NUM_VALUES);
+  for (std::size_t i = 0; i < values.size(); ++i) {
+    values[i] = i * 1000;
+  }
+  error = elias_fano.build(values.data(), values.size());
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  error = elias_fano.write(writer);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  error = writer.flush();
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+  // 1000 needs 10 bits, 9 of which are lower bits, and the higher bits take
+  // about 2 bits per value.
+  ASSERT_EQ(9U, elias_fano.num_low_bits());
+  ASSERT_LT(stream.str().size(), NUM_VALUES * 2);
+}
+
+TEST_F(EliasFanoTest, IO) {
+  marisa2::Error error;
+  marisa2::grimoire::EliasFano elias_fano;
+
+  std::vector<std::uint64_t> values(NUM_VALUES);
+  for (std::uint64_t &value : values) {
+    value = random_() % (NUM_VALUES * 100);
+  }
+  std::sort(values.begin(), values.end());
+  error = elias_fano.build(values.data(), values.size());
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+  std::stringstream stream;
+  {
+    marisa2::grimoire::Writer writer;
+    error = writer.open(stream);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = elias_fano.write(writer);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = writer.flush();
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  }
+  const std::string image = stream.str();
+
+  {
+    marisa2::grimoire::EliasFano elias_fano2;
+    marisa2::grimoire::Reader reader;
+    error = reader.open(stream);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = elias_fano2.read(reader, elias_fano.header());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    ASSERT_EQ(values.size(), elias_fano2.size());
+    for (std::size_t i = 0; i < values.size(); ++i) {
+      ASSERT_EQ(values[i], elias_fano2[i]) << i;
+      ASSERT_EQ(elias_fano.next_geq(values[i] + 1),
+                elias_fano2.next_geq(values[i] + 1)) << i;
+    }
+  }
+
+  {
+    marisa2::grimoire::EliasFano elias_fano2;
+    marisa2::grimoire::Mapper mapper;
+    error = mapper.open(image.data(), image.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = elias_fano2.map(mapper, elias_fano.header());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    ASSERT_EQ(values.size(), elias_fano2.size());
+    for (std::size_t i = 0; i < values.size(); ++i) {
+      ASSERT_EQ(values[i], elias_fano2[i]) << i;
+      ASSERT_EQ(elias_fano.next_geq(values[i] + 1),
+                elias_fano2.next_geq(values[i] + 1)) << i;
+    }
+  }
+
+  // Headers that do not match the image are rejected.
+  std::vector<marisa2::grimoire::EliasFanoHeader> headers(3,
+      elias_fano.header());
+  headers[0].high.flags &= ~MARISA2_ENABLE_SELECT_0;
+  headers[1].num_low_bits = 63;
+  headers[2].high.size += 64;
+  for (const marisa2::grimoire::EliasFanoHeader &header : headers) {
+    marisa2::grimoire::EliasFano elias_fano2;
+    marisa2::grimoire::Mapper mapper;
+    error = mapper.open(image.data(), image.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = elias_fano2.map(mapper, header);
+    ASSERT_NE(MARISA2_NO_ERROR, error.code());
+    ASSERT_EQ(0U, elias_fano2.size());
+
+    std::stringstream stream2(image);
+    marisa2::grimoire::Reader reader;
+    error = reader.open(stream2);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = elias_fano2.read(reader, header);
+    ASSERT_NE(MARISA2_NO_ERROR, error.code());
+    ASSERT_EQ(0U, elias_fano2.size());
+  }
+}
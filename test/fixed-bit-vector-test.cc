@@ -0,0 +1,228 @@
+#include "gtest/gtest.h"
+
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <marisa2/grimoire/fixed-bit-vector.h>
+
+class FixedBitVectorTest : public testing::Test {
+ protected:
+  // This function is called before each test.
+  virtual void SetUp() {
+  }
+
+  // This function is called after each test.
+  virtual void TearDown() {
+  }
+
+  static constexpr std::size_t NUM_BITS = 1 << 18;
+
+  static std::mt19937_64 random_;
+
+  // Build() builds a random bit vector with flags.
+  static void Build(int flags, marisa2::grimoire::BitVector *bit_vector) {
+    marisa2::Error error;
+    for (std::size_t i = 0; i < (NUM_BITS / 64); ++i) {
+      error = bit_vector->push_back_word(random_() & random_());
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    }
+    error = bit_vector->push_back_bits(random_(), 35);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector->build(flags);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  }
+
+  // Check() builds FixedBitVector<Flags> from a copy of bit_vector and
+  // compares their queries.
+  template <int Flags>
+  static void Check() {
+    marisa2::Error error;
+    marisa2::grimoire::BitVector bit_vector;
+    Build(Flags | MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0,
+          &bit_vector);
+
+    // The image of bit_vector is read and then given to build(), which
+    // drops or adds select indices to fit Flags.
+    std::stringstream stream;
+    marisa2::grimoire::Writer writer;
+    error = writer.open(stream);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.write(writer);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = writer.flush();
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+    marisa2::grimoire::BitVector copy;
+    marisa2::grimoire::Reader reader;
+    error = reader.open(stream);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = copy.read(reader, bit_vector.header());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+    marisa2::grimoire::FixedBitVector<Flags> fixed;
+    error = fixed.build(copy);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    ASSERT_EQ(0U, copy.size());
+
+    ASSERT_EQ(bit_vector.size(), fixed.size());
+    ASSERT_EQ(bit_vector.num_1s(), fixed.num_1s());
+    ASSERT_EQ(static_cast<std::uint64_t>(Flags | MARISA2_ENABLE_RANK),
+              fixed.header().flags);
+    for (std::size_t i = 0; i < bit_vector.size(); ++i) {
+      ASSERT_EQ(bit_vector[i], fixed[i]) << i;
+      ASSERT_EQ(bit_vector.rank_1(i), fixed.rank_1(i)) << i;
+    }
+    CheckSelect(bit_vector, fixed);
+
+    // The image of a fixed bit vector can be mapped as a BitVector.
+    std::stringstream stream2;
+    marisa2::grimoire::Writer writer2;
+    error = writer2.open(stream2);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = fixed.write(writer2);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = writer2.flush();
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    const std::string image = stream2.str();
+
+    marisa2::grimoire::Mapper mapper;
+    error = mapper.open(image.data(), image.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    marisa2::grimoire::BitVector mapped;
+    error = mapped.map(mapper, fixed.header());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    ASSERT_EQ(fixed.size(), mapped.size());
+    for (std::size_t i = 0; i < bit_vector.size(); i += 61) {
+      ASSERT_EQ(fixed.rank_1(i), mapped.rank_1(i)) << i;
+    }
+
+    // And vice versa.
+    marisa2::grimoire::FixedBitVector<Flags> mapped_fixed;
+    error = mapper.open(image.data(), image.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = mapped_fixed.map(mapper, fixed.header());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    ASSERT_EQ(fixed.size(), mapped_fixed.size());
+    for (std::size_t i = 0; i < bit_vector.size(); i += 61) {
+      ASSERT_EQ(fixed.rank_1(i), mapped_fixed.rank_1(i)) << i;
+    }
+  }
+
+  // CheckSelect() compares select_1/0() if they are enabled.
+  template <int Flags>
+  static void CheckSelect(
+      const marisa2::grimoire::BitVector &bit_vector,
+      const marisa2::grimoire::FixedBitVector<Flags> &fixed) {
+    CheckSelect1(bit_vector, fixed, std::integral_constant<bool,
+        (Flags & MARISA2_ENABLE_SELECT_1) != 0>());
+    CheckSelect0(bit_vector, fixed, std::integral_constant<bool,
+        (Flags & MARISA2_ENABLE_SELECT_0) != 0>());
+  }
+  template <typename T>
+  static void CheckSelect1(const marisa2::grimoire::BitVector &bit_vector,
+                           const T &fixed, std::true_type) {
+    for (std::size_t i = 0; i < bit_vector.num_1s(); ++i) {
+      ASSERT_EQ(bit_vector.select_1(i), fixed.select_1(i)) << i;
+    }
+  }
+  template <typename T>
+  static void CheckSelect1(const marisa2::grimoire::BitVector &,
+                           const T &, std::false_type) {}
+  template <typename T>
+  static void CheckSelect0(const marisa2::grimoire::BitVector &bit_vector,
+                           const T &fixed, std::true_type) {
+    for (std::size_t i = 0; i < bit_vector.num_0s(); ++i) {
+      ASSERT_EQ(bit_vector.select_0(i), fixed.select_0(i)) << i;
+    }
+  }
+  template <typename T>
+  static void CheckSelect0(const marisa2::grimoire::BitVector &,
+                           const T &, std::false_type) {}
+};
+
+constexpr std::size_t FixedBitVectorTest::NUM_BITS;
+std::mt19937_64 FixedBitVectorTest::random_;
+
+TEST_F(FixedBitVectorTest, DefaultConstructor) {
+  marisa2::grimoire::FixedBitVector<MARISA2_ENABLE_SELECT_1> bit_vector;
+
+  ASSERT_FALSE(static_cast<bool>(bit_vector));
+  ASSERT_EQ(0U, bit_vector.size());
+  ASSERT_EQ(0U, bit_vector.num_1s());
+  ASSERT_EQ(0U, bit_vector.num_0s());
+}
+
+TEST_F(FixedBitVectorTest, Size) {
+  // Disabled features take no space.
+  ASSERT_LT(sizeof(marisa2::grimoire::FixedBitVector<0>),
+            sizeof(marisa2::grimoire::FixedBitVector<
+                   MARISA2_ENABLE_SELECT_1>));
+  ASSERT_LT(sizeof(marisa2::grimoire::FixedBitVector<
+                   MARISA2_ENABLE_SELECT_1>),
+            sizeof(marisa2::grimoire::FixedBitVector<
+                   MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0>));
+  ASSERT_LT(sizeof(marisa2::grimoire::FixedBitVector<
+                   MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0 |
+                   MARISA2_CACHE_LINE_LAYOUT>),
+            sizeof(marisa2::grimoire::BitVector));
+}
+
+TEST_F(FixedBitVectorTest, Build) {
+  marisa2::Error error;
+  marisa2::grimoire::FixedBitVector<MARISA2_CACHE_LINE_LAYOUT> fixed;
+  marisa2::grimoire::BitVector bit_vector;
+
+  error = fixed.build(bit_vector);
+  ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+
+  Build(0, &bit_vector);
+  error = fixed.build(bit_vector);
+  ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+  ASSERT_EQ(NUM_BITS + 35, bit_vector.size());
+
+  marisa2::grimoire::Mapper mapper;
+  error = fixed.map(mapper, bit_vector.header());
+  ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+}
+
+TEST_F(FixedBitVectorTest, Pack) {
+  Check<0>();
+  Check<MARISA2_ENABLE_SELECT_1>();
+  Check<MARISA2_ENABLE_SELECT_0>();
+  Check<MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0>();
+}
+
+TEST_F(FixedBitVectorTest, CacheLineLayout) {
+  Check<MARISA2_CACHE_LINE_LAYOUT>();
+  Check<MARISA2_CACHE_LINE_LAYOUT | MARISA2_ENABLE_SELECT_1>();
+  Check<MARISA2_CACHE_LINE_LAYOUT | MARISA2_ENABLE_SELECT_1 |
+        MARISA2_ENABLE_SELECT_0>();
+}
+
+TEST_F(FixedBitVectorTest, WideIndex) {
+  Check<MARISA2_WIDE_INDEX>();
+  Check<MARISA2_WIDE_INDEX | MARISA2_ENABLE_SELECT_1 |
+        MARISA2_ENABLE_SELECT_0>();
+  Check<MARISA2_WIDE_INDEX | MARISA2_CACHE_LINE_LAYOUT |
+        MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0>();
+}
+
+TEST_F(FixedBitVectorTest, SelectInterval) {
+  Check<MARISA2_SELECT_INTERVAL_64 | MARISA2_ENABLE_SELECT_1 |
+        MARISA2_ENABLE_SELECT_0>();
+  Check<MARISA2_CACHE_LINE_LAYOUT | MARISA2_SELECT_INTERVAL_8192 |
+        MARISA2_ENABLE_SELECT_1 | MARISA2_ENABLE_SELECT_0>();
+  Check<MARISA2_WIDE_INDEX | MARISA2_SELECT_INTERVAL_1024 |
+        MARISA2_ENABLE_SELECT_1>();
+
+  // A bit vector with another interval is rejected.
+  marisa2::Error error;
+  marisa2::grimoire::FixedBitVector<MARISA2_SELECT_INTERVAL_64> fixed;
+  marisa2::grimoire::BitVector bit_vector;
+  Build(MARISA2_SELECT_INTERVAL_128, &bit_vector);
+  error = fixed.build(bit_vector);
+  ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+  ASSERT_EQ(NUM_BITS + 35, bit_vector.size());
+}
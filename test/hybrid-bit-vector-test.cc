@@ -0,0 +1,180 @@
+#include "gtest/gtest.h"
+#include "bit-vector-check.h"
+
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <marisa2/grimoire/hybrid-bit-vector.h>
+
+class HybridBitVectorTest : public testing::Test {
+ protected:
+  // This function is called before each test.
+  virtual void SetUp() {
+  }
+
+  // This function is called after each test.
+  virtual void TearDown() {
+  }
+
+  static constexpr std::size_t BLOCK_SIZE = 1 << 16;
+
+  static std::mt19937_64 random_;
+
+  // Generate() appends a block of each density to bits, and then a partial
+  // block of random bits.
+  static void Generate(std::vector<bool> *bits) {
+    // Dense random bits.
+    for (std::size_t i = 0; i < BLOCK_SIZE; ++i) {
+      bits->push_back((random_() % 2) != 0);
+    }
+    // Sparse 1s and sparse 0s.
+    for (std::size_t i = 0; i < BLOCK_SIZE; ++i) {
+      bits->push_back((random_() % 1000) == 0);
+    }
+    for (std::size_t i = 0; i < BLOCK_SIZE; ++i) {
+      bits->push_back((random_() % 1000) != 0);
+    }
+    // Long runs.
+    for (bool bit = false; bits->size() < (BLOCK_SIZE * 4); bit = !bit) {
+      const std::size_t length = 1 + (random_() % 1000);
+      for (std::size_t i = 0; i < length; ++i) {
+        bits->push_back(bit);
+      }
+    }
+    bits->resize(BLOCK_SIZE * 4);
+    // All 0s and all 1s.
+    bits->insert(bits->end(), BLOCK_SIZE, false);
+    bits->insert(bits->end(), BLOCK_SIZE, true);
+    for (std::size_t i = 0; i < 10000; ++i) {
+      bits->push_back((random_() % 2) != 0);
+    }
+  }
+
+  // Build() pushes bits in random widths and builds bit_vector.
+  static void Build(const std::vector<bool> &bits,
+                    marisa2::grimoire::HybridBitVector *bit_vector) {
+    for (std::size_t i = 0; i < bits.size(); ) {
+      std::size_t num_bits = random_() % 65;
+      if (num_bits > (bits.size() - i)) {
+        num_bits = bits.size() - i;
+      }
+      std::uint64_t word = 0;
+      for (std::size_t j = 0; j < num_bits; ++j) {
+        word |= std::uint64_t(bits[i + j]) << j;
+      }
+      // The bits beyond num_bits must be ignored.
+      if (num_bits < 64) {
+        word |= ~std::uint64_t(0) << num_bits;
+      }
+      marisa2::Error error = bit_vector->push_back_bits(word, num_bits);
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+      i += num_bits;
+    }
+    marisa2::Error error = bit_vector->build();
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  }
+};
+
+constexpr std::size_t HybridBitVectorTest::BLOCK_SIZE;
+std::mt19937_64 HybridBitVectorTest::random_;
+
+TEST_F(HybridBitVectorTest, DefaultConstructor) {
+  marisa2::grimoire::HybridBitVector bit_vector;
+
+  ASSERT_FALSE(static_cast<bool>(bit_vector));
+  ASSERT_EQ(0U, bit_vector.size());
+  ASSERT_EQ(0U, bit_vector.num_1s());
+  ASSERT_EQ(0U, bit_vector.total_size());
+}
+
+TEST_F(HybridBitVectorTest, Build) {
+  marisa2::Error error;
+  marisa2::grimoire::HybridBitVector bit_vector;
+
+  marisa2::grimoire::Writer writer;
+  error = bit_vector.write(writer);
+  ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+  error = bit_vector.push_back_bits(0, 65);
+  ASSERT_EQ(MARISA2_RANGE_ERROR, error.code()) << error.message();
+
+  error = bit_vector.build();
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  ASSERT_EQ(0U, bit_vector.size());
+  ASSERT_EQ(0U, bit_vector.rank_1(0));
+
+  error = bit_vector.push_back(true);
+  ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+  error = bit_vector.build();
+  ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+}
+
+TEST_F(HybridBitVectorTest, Random) {
+  std::vector<bool> bits;
+  Generate(&bits);
+
+  marisa2::grimoire::HybridBitVector bit_vector;
+  Build(bits, &bit_vector);
+  CheckBitVector(bit_vector, bits);
+
+  // The first and the last blocks are plain, the sparse blocks are sparse,
+  // and the blocks of runs are run-length encoded.
+  ASSERT_EQ(2U, bit_vector.num_blocks(
+      marisa2::grimoire::HybridBitVector::PLAIN_BLOCK));
+  ASSERT_EQ(2U, bit_vector.num_blocks(
+      marisa2::grimoire::HybridBitVector::SPARSE_BLOCK));
+  ASSERT_EQ(3U, bit_vector.num_blocks(
+      marisa2::grimoire::HybridBitVector::RUN_BLOCK));
+  ASSERT_LT(bit_vector.total_size(), bits.size() / 8);
+}
+
+TEST_F(HybridBitVectorTest, IO) {
+  marisa2::Error error;
+  std::vector<bool> bits;
+  Generate(&bits);
+
+  marisa2::grimoire::HybridBitVector bit_vector;
+  Build(bits, &bit_vector);
+
+  std::stringstream stream;
+  {
+    marisa2::grimoire::Writer writer;
+    error = writer.open(stream);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.write(writer);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = writer.flush();
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  }
+  const std::string image = stream.str();
+  ASSERT_EQ(bit_vector.total_size(), image.size());
+
+  {
+    marisa2::grimoire::HybridBitVector bit_vector2;
+    marisa2::grimoire::Reader reader;
+    error = reader.open(stream);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector2.read(reader, bit_vector.header());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    CheckBitVector(bit_vector2, bits);
+  }
+
+  {
+    marisa2::grimoire::HybridBitVector bit_vector2;
+    marisa2::grimoire::Mapper mapper;
+    error = mapper.open(image.data(), image.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector2.map(mapper, bit_vector.header());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    CheckBitVector(bit_vector2, bits);
+
+    marisa2::grimoire::HybridBitVectorHeader header = bit_vector.header();
+    ++header.num_1s;
+    marisa2::grimoire::HybridBitVector bit_vector3;
+    error = mapper.open(image.data(), image.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector3.map(mapper, header);
+    ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+  }
+}
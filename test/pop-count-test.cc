@@ -63,3 +63,25 @@ TEST_F(PopCountTest, PopCount) {
               marisa2::grimoire::PopCount::pop_count(src));
   }
 }
+
+TEST_F(PopCountTest, Broadword) {
+  for (int i = 0; i < NUM_VALUES; ++i) {
+    std::uint64_t src = random_();
+    ASSERT_EQ(static_cast<std::uint8_t>(::__builtin_popcountll(src)),
+              marisa2::grimoire::PopCount::pop_count_broadword(src));
+  }
+}
+
+TEST_F(PopCountTest, Popcnt) {
+  if (!marisa2::grimoire::PopCount::uses_popcnt()) {
+    return;
+  }
+
+  ASSERT_EQ(0U, marisa2::grimoire::PopCount::pop_count_popcnt(0));
+  ASSERT_EQ(64U, marisa2::grimoire::PopCount::pop_count_popcnt(~0ULL));
+  for (int i = 0; i < NUM_VALUES; ++i) {
+    std::uint64_t src = random_();
+    ASSERT_EQ(static_cast<std::uint8_t>(::__builtin_popcountll(src)),
+              marisa2::grimoire::PopCount::pop_count_popcnt(src));
+  }
+}
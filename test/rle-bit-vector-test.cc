@@ -0,0 +1,188 @@
+#include "gtest/gtest.h"
+#include "bit-vector-check.h"
+
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <marisa2/grimoire/rle-bit-vector.h>
+
+class RleBitVectorTest : public testing::Test {
+ protected:
+  // This function is called before each test.
+  virtual void SetUp() {
+  }
+
+  // This function is called after each test.
+  virtual void TearDown() {
+  }
+
+  static constexpr std::size_t NUM_BITS = 1 << 16;
+
+  static std::mt19937_64 random_;
+};
+
+constexpr std::size_t RleBitVectorTest::NUM_BITS;
+std::mt19937_64 RleBitVectorTest::random_;
+
+TEST_F(RleBitVectorTest, DefaultConstructor) {
+  marisa2::grimoire::RleBitVector bit_vector;
+
+  ASSERT_FALSE(static_cast<bool>(bit_vector));
+  ASSERT_EQ(0U, bit_vector.size());
+  ASSERT_EQ(0U, bit_vector.num_1s());
+  ASSERT_EQ(0U, bit_vector.num_runs());
+}
+
+TEST_F(RleBitVectorTest, PushBackRun) {
+  marisa2::Error error;
+  marisa2::grimoire::RleBitVector bit_vector;
+
+  error = bit_vector.push_back_run(false, 100);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  error = bit_vector.push_back_run(true, 1000);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  error = bit_vector.push_back_run(true, 24);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  error = bit_vector.push_back_run(false, 1 << 20);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  error = bit_vector.push_back(true);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  error = bit_vector.build();
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+  ASSERT_EQ(100U + 1024 + (1 << 20) + 1, bit_vector.size());
+  ASSERT_EQ(1025U, bit_vector.num_1s());
+  ASSERT_EQ(2U, bit_vector.num_runs());
+  ASSERT_EQ(100U, bit_vector.select_1(0));
+  ASSERT_EQ(1123U, bit_vector.select_1(1023));
+  ASSERT_EQ(bit_vector.size() - 1, bit_vector.select_1(1024));
+  ASSERT_EQ(99U, bit_vector.select_0(99));
+  ASSERT_EQ(1124U, bit_vector.select_0(100));
+  ASSERT_EQ(1024U, bit_vector.rank_1(bit_vector.size() - 1));
+  ASSERT_EQ(3U * 16, bit_vector.total_size());
+
+  error = bit_vector.push_back(true);
+  ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+}
+
+TEST_F(RleBitVectorTest, Random) {
+  const std::size_t max_runs[] = { 1, 4, 100, 10000 };
+  for (std::size_t max_run : max_runs) {
+    marisa2::Error error;
+    marisa2::grimoire::RleBitVector bit_vector;
+    std::vector<bool> bits;
+
+    // Runs of random lengths are pushed by push_back_bits().
+    bool bit = (random_() % 2) != 0;
+    std::uint64_t word = 0;
+    std::size_t num_bits = 0;
+    while (bits.size() < NUM_BITS) {
+      const std::size_t length = 1 + (random_() % max_run);
+      for (std::size_t i = 0; i < length; ++i) {
+        bits.push_back(bit);
+        word |= std::uint64_t(bit) << num_bits;
+        if (++num_bits == 64) {
+          error = bit_vector.push_back_bits(word, 64);
+          ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+          word = 0;
+          num_bits = 0;
+        }
+      }
+      bit = !bit;
+    }
+    error = bit_vector.push_back_bits(word, num_bits);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.build();
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+    CheckBitVector(bit_vector, bits);
+  }
+}
+
+TEST_F(RleBitVectorTest, IO) {
+  marisa2::Error error;
+  marisa2::grimoire::RleBitVector bit_vector;
+  std::vector<bool> bits;
+
+  for (std::size_t i = 0; bits.size() < NUM_BITS; ++i) {
+    const std::size_t length = 1 + (random_() % 1000);
+    error = bit_vector.push_back_run((i % 2) != 0, length);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    bits.insert(bits.end(), length, (i % 2) != 0);
+  }
+  error = bit_vector.build();
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+  std::stringstream stream;
+  {
+    marisa2::grimoire::Writer writer;
+    error = writer.open(stream);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.write(writer);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = writer.flush();
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  }
+  const std::string image = stream.str();
+  ASSERT_EQ(bit_vector.total_size(), image.size());
+
+  {
+    marisa2::grimoire::RleBitVector bit_vector2;
+    marisa2::grimoire::Reader reader;
+    error = reader.open(stream);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector2.read(reader, bit_vector.header());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    CheckBitVector(bit_vector2, bits);
+  }
+
+  {
+    marisa2::grimoire::RleBitVector bit_vector2;
+    marisa2::grimoire::Mapper mapper;
+    error = mapper.open(image.data(), image.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector2.map(mapper, bit_vector.header());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    CheckBitVector(bit_vector2, bits);
+  }
+
+  // num_runs + 1 must not wrap around.
+  {
+    marisa2::grimoire::RleBitVector bit_vector2;
+    marisa2::grimoire::Mapper mapper;
+    error = mapper.open(image.data(), image.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    const std::uint64_t max = std::numeric_limits<std::size_t>::max();
+    error = bit_vector2.map(mapper,
+        marisa2::grimoire::RleBitVectorHeader{ max, max, max });
+    ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+  }
+
+  // The sentinel run must match the header.
+  {
+    marisa2::grimoire::RleBitVector bit_vector2;
+    marisa2::grimoire::RleBitVectorHeader header = bit_vector.header();
+    --header.num_runs;
+    marisa2::grimoire::Mapper mapper;
+    error = mapper.open(image.data(), image.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector2.map(mapper, header);
+    ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+  }
+
+  {
+    std::string broken = image;
+    broken[broken.size() - 1] ^= 1;
+    std::stringstream broken_stream(broken);
+    marisa2::grimoire::RleBitVector bit_vector2;
+    marisa2::grimoire::Reader reader;
+    error = reader.open(broken_stream);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector2.read(reader, bit_vector.header());
+    ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+    ASSERT_EQ(0U, bit_vector2.size());
+  }
+}
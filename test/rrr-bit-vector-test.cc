@@ -0,0 +1,206 @@
+#include "gtest/gtest.h"
+#include "bit-vector-check.h"
+
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <marisa2/grimoire/rrr-bit-vector.h>
+
+class RrrBitVectorTest : public testing::Test {
+ protected:
+  // This function is called before each test.
+  virtual void SetUp() {
+  }
+
+  // This function is called after each test.
+  virtual void TearDown() {
+  }
+
+  static constexpr std::size_t NUM_BITS = 1 << 16;
+
+  static std::mt19937_64 random_;
+};
+
+constexpr std::size_t RrrBitVectorTest::NUM_BITS;
+std::mt19937_64 RrrBitVectorTest::random_;
+
+TEST_F(RrrBitVectorTest, DefaultConstructor) {
+  marisa2::grimoire::RrrBitVector bit_vector;
+
+  ASSERT_FALSE(static_cast<bool>(bit_vector));
+  ASSERT_EQ(0U, bit_vector.size());
+  ASSERT_EQ(0U, bit_vector.num_1s());
+  ASSERT_EQ(0U, bit_vector.num_0s());
+}
+
+TEST_F(RrrBitVectorTest, Build) {
+  marisa2::Error error;
+  marisa2::grimoire::RrrBitVector bit_vector;
+
+  error = bit_vector.build();
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  ASSERT_EQ(0U, bit_vector.rank_1(0));
+
+  error = bit_vector.build();
+  ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+  error = bit_vector.push_back(true);
+  ASSERT_EQ(MARISA2_STATE_ERROR, error.code()) << error.message();
+}
+
+TEST_F(RrrBitVectorTest, Random) {
+  const double densities[] = { 0.0, 0.001, 0.05, 0.5, 0.95, 0.999, 1.0 };
+  const std::size_t sizes[] = {
+    1, 62, 63, 64, 504, 505, 1009, 2015, 2016, 2017, NUM_BITS
+  };
+  for (double density : densities) {
+    for (std::size_t size : sizes) {
+      marisa2::Error error;
+      marisa2::grimoire::RrrBitVector bit_vector;
+      std::vector<bool> bits;
+
+      std::bernoulli_distribution distribution(density);
+      for (std::size_t i = 0; i < size; ++i) {
+        const bool bit = distribution(random_);
+        error = bit_vector.push_back(bit);
+        ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+        bits.push_back(bit);
+      }
+      error = bit_vector.build();
+      ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+      CheckBitVector(bit_vector, bits);
+    }
+  }
+}
+
+TEST_F(RrrBitVectorTest, PushBackBits) {
+  marisa2::Error error;
+  marisa2::grimoire::RrrBitVector bit_vector;
+  std::vector<bool> bits;
+
+  for (std::size_t i = 0; i < (NUM_BITS / 32); ++i) {
+    const std::size_t num_bits = random_() % 65;
+    const std::uint64_t word = random_() & random_() & random_();
+    error = bit_vector.push_back_bits(word, num_bits);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    for (std::size_t j = 0; j < num_bits; ++j) {
+      bits.push_back((word >> j) & 1);
+    }
+  }
+  error = bit_vector.push_back_bits(0, 65);
+  ASSERT_EQ(MARISA2_RANGE_ERROR, error.code()) << error.message();
+  error = bit_vector.build();
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+  CheckBitVector(bit_vector, bits);
+}
+
+TEST_F(RrrBitVectorTest, Compression) {
+  marisa2::Error error;
+  marisa2::grimoire::RrrBitVector bit_vector;
+
+  std::bernoulli_distribution distribution(0.01);
+  for (std::size_t i = 0; i < NUM_BITS; ++i) {
+    error = bit_vector.push_back(distribution(random_));
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  }
+  error = bit_vector.build();
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+  // A sparse bit vector must be much smaller than its plain bits.
+  ASSERT_LT(bit_vector.total_size(), NUM_BITS / 8 / 3);
+}
+
+TEST_F(RrrBitVectorTest, IO) {
+  marisa2::Error error;
+  marisa2::grimoire::RrrBitVector bit_vector;
+  std::vector<bool> bits;
+
+  std::bernoulli_distribution distribution(0.1);
+  for (std::size_t i = 0; i < NUM_BITS; ++i) {
+    const bool bit = distribution(random_);
+    error = bit_vector.push_back(bit);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    bits.push_back(bit);
+  }
+  error = bit_vector.build();
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+  std::stringstream stream;
+  {
+    marisa2::grimoire::Writer writer;
+    error = writer.open(stream);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector.write(writer);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = writer.flush();
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  }
+  const std::string image = stream.str();
+  ASSERT_EQ(bit_vector.total_size(), image.size());
+
+  {
+    marisa2::grimoire::RrrBitVector bit_vector2;
+    marisa2::grimoire::Reader reader;
+    error = reader.open(stream);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector2.read(reader, bit_vector.header());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    CheckBitVector(bit_vector2, bits);
+  }
+
+  {
+    marisa2::grimoire::RrrBitVector bit_vector2;
+    marisa2::grimoire::Mapper mapper;
+    error = mapper.open(image.data(), image.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector2.map(mapper, bit_vector.header());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    CheckBitVector(bit_vector2, bits);
+  }
+
+  {
+    marisa2::grimoire::RrrBitVector bit_vector2;
+    marisa2::grimoire::RrrBitVectorHeader header = bit_vector.header();
+    header.num_1s = header.size + 1;
+    marisa2::grimoire::Mapper mapper;
+    error = mapper.open(image.data(), image.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector2.map(mapper, header);
+    ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+  }
+
+  // The sentinel sample at the end of the image must match the header.
+  {
+    marisa2::grimoire::RrrBitVector bit_vector2;
+    marisa2::grimoire::RrrBitVectorHeader header = bit_vector.header();
+    --header.num_1s;
+    marisa2::grimoire::Mapper mapper;
+    error = mapper.open(image.data(), image.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector2.map(mapper, header);
+    ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+  }
+
+  {
+    // The sentinel has rank, offset_pos, and rels of 8 bytes each.
+    std::string broken = image;
+    broken[broken.size() - 16] ^= 1;
+    marisa2::grimoire::RrrBitVector bit_vector2;
+    marisa2::grimoire::Mapper mapper;
+    error = mapper.open(broken.data(), broken.size());
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector2.map(mapper, bit_vector.header());
+    ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+
+    std::stringstream broken_stream(broken);
+    marisa2::grimoire::Reader reader;
+    error = reader.open(broken_stream);
+    ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+    error = bit_vector2.read(reader, bit_vector.header());
+    ASSERT_EQ(MARISA2_FORMAT_ERROR, error.code()) << error.message();
+    ASSERT_EQ(0U, bit_vector2.size());
+  }
+}
@@ -0,0 +1,105 @@
+#include "gtest/gtest.h"
+
+#include <random>
+
+#include <marisa2/grimoire/select-bit.h>
+
+class SelectBitTest : public testing::Test {
+ protected:
+  // This function is called before each test.
+  virtual void SetUp() {
+  }
+
+  // This function is called after each test.
+  virtual void TearDown() {
+  }
+
+  static constexpr int NUM_VALUES = 1 << 16;
+
+  static std::mt19937_64 random_;
+
+  // naive_select_bit() returns the position of the (i + 1)-th 1 in x.
+  static std::size_t naive_select_bit(std::uint64_t x, std::size_t i) {
+    for (std::size_t pos = 0; pos < 64; ++pos) {
+      if ((x >> pos) & 1) {
+        if (i-- == 0) {
+          return pos;
+        }
+      }
+    }
+    return 64;
+  }
+};
+
+std::mt19937_64 SelectBitTest::random_;
+
+TEST_F(SelectBitTest, SelectBit) {
+  for (int i = 0; i < NUM_VALUES; ++i) {
+    // Sparse and dense values are generated by combining random values.
+    std::uint64_t src = random_();
+    if (i % 3 == 1) {
+      src &= random_() & random_();
+    } else if (i % 3 == 2) {
+      src |= random_() | random_();
+    }
+    const std::size_t num_1s = ::__builtin_popcountll(src);
+    for (std::size_t j = 0; j < num_1s; ++j) {
+      ASSERT_EQ(naive_select_bit(src, j),
+                marisa2::grimoire::SelectBit::select_bit(src, j));
+    }
+  }
+}
+
+TEST_F(SelectBitTest, Broadword) {
+  for (std::size_t i = 0; i < 64; ++i) {
+    const std::uint64_t src = std::uint64_t(1) << i;
+    ASSERT_EQ(i, marisa2::grimoire::SelectBit::select_bit_broadword(src, 0));
+  }
+
+  const std::uint64_t all_1s = ~std::uint64_t(0);
+  for (std::size_t i = 0; i < 64; ++i) {
+    ASSERT_EQ(i, marisa2::grimoire::SelectBit::select_bit_broadword(
+        all_1s, i));
+  }
+
+  for (int i = 0; i < NUM_VALUES; ++i) {
+    const std::uint64_t src = random_();
+    const std::size_t num_1s = ::__builtin_popcountll(src);
+    for (std::size_t j = 0; j < num_1s; ++j) {
+      ASSERT_EQ(naive_select_bit(src, j),
+                marisa2::grimoire::SelectBit::select_bit_broadword(src, j));
+    }
+  }
+}
+
+TEST_F(SelectBitTest, BMI2) {
+  if (!marisa2::grimoire::SelectBit::uses_bmi2()) {
+    return;
+  }
+
+  for (int i = 0; i < NUM_VALUES; ++i) {
+    const std::uint64_t src = random_();
+    const std::size_t num_1s = ::__builtin_popcountll(src);
+    for (std::size_t j = 0; j < num_1s; ++j) {
+      ASSERT_EQ(naive_select_bit(src, j),
+                marisa2::grimoire::SelectBit::select_bit_bmi2(src, j));
+    }
+  }
+}
+
+TEST_F(SelectBitTest, LowestAndHighestBits) {
+  for (std::size_t pos = 0; pos < 64; ++pos) {
+    const std::uint64_t bit = std::uint64_t(1) << pos;
+    ASSERT_EQ(pos, marisa2::grimoire::SelectBit::lowest_bit(bit));
+    ASSERT_EQ(pos, marisa2::grimoire::SelectBit::highest_bit(bit));
+  }
+  for (int i = 0; i < NUM_VALUES; ++i) {
+    const std::uint64_t src = random_() | 1;
+    const std::uint64_t x = src << (i % 64);
+    const std::size_t num_1s = ::__builtin_popcountll(x);
+    ASSERT_EQ(naive_select_bit(x, 0),
+              marisa2::grimoire::SelectBit::lowest_bit(x));
+    ASSERT_EQ(naive_select_bit(x, num_1s - 1),
+              marisa2::grimoire::SelectBit::highest_bit(x));
+  }
+}
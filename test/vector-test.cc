@@ -285,6 +285,23 @@ TEST_F(VectorTest, Reserve) {
   ASSERT_EQ(MARISA2_RANGE_ERROR, error.code()) << error.message();
 }
 
+TEST_F(VectorTest, Swap) {
+  marisa2::Error error;
+  marisa2::grimoire::Vector<int> vector;
+  marisa2::grimoire::Vector<int> vector2;
+
+  error = vector.push_back(123);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+  error = vector2.resize(3, 456);
+  ASSERT_EQ(MARISA2_NO_ERROR, error.code()) << error.message();
+
+  vector.swap(vector2);
+  ASSERT_EQ(3U, vector.size());
+  ASSERT_EQ(456, vector[2]);
+  ASSERT_EQ(1U, vector2.size());
+  ASSERT_EQ(123, vector2[0]);
+}
+
 TEST_F(VectorTest, Begin) {
   marisa2::Error error;
   marisa2::grimoire::Vector<int> vector;